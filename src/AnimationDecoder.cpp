@@ -0,0 +1,121 @@
+#include "AnimationDecoder.hpp"
+
+#include <ien/fs_utils.hpp>
+#include <ien/str_utils.hpp>
+
+#include "ApngDecoder.hpp"
+
+namespace
+{
+    // Enough to ride out a slow frame without holding many full-size frames in memory
+    constexpr size_t FRAMES_AHEAD = 4;
+}
+
+ImageReaderDecoder::ImageReaderDecoder(const std::string& path)
+    : _reader(QString::fromStdString(path))
+    , _frameCount(_reader.imageCount())
+{
+}
+
+std::optional<AnimationFrame> ImageReaderDecoder::next()
+{
+    if (!_reader.canRead())
+    {
+        return std::nullopt;
+    }
+
+    QImage image = _reader.read();
+    if (image.isNull())
+    {
+        return std::nullopt;
+    }
+    return AnimationFrame{ .image = std::move(image), .delay = _reader.nextImageDelay() };
+}
+
+DecodeAheadDecoder::DecodeAheadDecoder(std::unique_ptr<AnimationDecoder> decoder, const size_t framesAhead)
+    : _decoder(std::move(decoder))
+    , _frameCount(_decoder->frameCount())
+    , _framesAhead(std::max<size_t>(framesAhead, 1))
+    , _thread([this] { run(); })
+{
+}
+
+DecodeAheadDecoder::~DecodeAheadDecoder()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+    _thread.join();
+}
+
+std::optional<AnimationFrame> DecodeAheadDecoder::next()
+{
+    std::unique_lock lock(_mutex);
+    if (_frames.empty())
+    {
+        return std::nullopt;
+    }
+
+    AnimationFrame frame = std::move(_frames.front());
+    _frames.pop_front();
+    lock.unlock();
+    _condition.notify_all();
+    return frame;
+}
+
+bool DecodeAheadDecoder::isFinished()
+{
+    std::lock_guard lock(_mutex);
+    return _finished && _frames.empty();
+}
+
+void DecodeAheadDecoder::run()
+{
+    for (;;)
+    {
+        {
+            std::unique_lock lock(_mutex);
+            _condition.wait(lock, [this] { return _stopping || _frames.size() < _framesAhead; });
+            if (_stopping)
+            {
+                return;
+            }
+        }
+
+        // Decoded without the lock, the player never waits on it
+        auto frame = _decoder->next();
+        {
+            std::lock_guard lock(_mutex);
+            if (frame)
+            {
+                _frames.push_back(std::move(*frame));
+            }
+            else
+            {
+                _finished = true;
+            }
+        }
+        _condition.notify_all();
+
+        if (!frame)
+        {
+            return;
+        }
+    }
+}
+
+std::unique_ptr<DecodeAheadDecoder> openAnimationDecoder(const std::string& path)
+{
+    std::unique_ptr<AnimationDecoder> decoder;
+    if (ien::str_tolower(ien::get_file_extension(path)) == ".png")
+    {
+        decoder = ApngDecoder::open(path);
+    }
+    if (!decoder)
+    {
+        decoder = std::make_unique<ImageReaderDecoder>(path);
+    }
+    return std::make_unique<DecodeAheadDecoder>(std::move(decoder), FRAMES_AHEAD);
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <QImage>
+#include <QImageReader>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+struct AnimationFrame
+{
+    QImage image;
+    int delay = 0;
+};
+
+// Produces the frames of one loop of an animation in order
+class AnimationDecoder
+{
+public:
+    virtual ~AnimationDecoder() = default;
+
+    // Empty once the loop is over or a frame failed to decode
+    virtual std::optional<AnimationFrame> next() = 0;
+    virtual int frameCount() const = 0;
+};
+
+// Anything Qt has an animation capable image plugin for (GIF, WebP)
+class ImageReaderDecoder : public AnimationDecoder
+{
+public:
+    explicit ImageReaderDecoder(const std::string& path);
+
+    std::optional<AnimationFrame> next() override;
+    int frameCount() const override { return _frameCount; }
+
+private:
+    QImageReader _reader;
+    int _frameCount;
+};
+
+// Runs another decoder on its own thread, keeping a few frames ready ahead of playback
+class DecodeAheadDecoder
+{
+public:
+    DecodeAheadDecoder(std::unique_ptr<AnimationDecoder> decoder, size_t framesAhead);
+    DecodeAheadDecoder(const DecodeAheadDecoder&) = delete;
+    ~DecodeAheadDecoder();
+
+    // Never waits for the decoding thread: empty while the next frame isn't ready yet as well as at the end
+    std::optional<AnimationFrame> next();
+    // Whether the loop is over and every frame of it has been taken
+    bool isFinished();
+    int frameCount() const { return _frameCount; }
+
+private:
+    std::unique_ptr<AnimationDecoder> _decoder;
+    const int _frameCount;
+    const size_t _framesAhead;
+    std::deque<AnimationFrame> _frames;
+    bool _finished = false;
+    bool _stopping = false;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    // Declared last so that it starts after, and is joined before, the state it uses
+    std::thread _thread;
+
+    void run();
+};
+
+// Decoder for the animation at `path`, already decoding ahead
+std::unique_ptr<DecodeAheadDecoder> openAnimationDecoder(const std::string& path);
\ No newline at end of file
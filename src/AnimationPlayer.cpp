@@ -0,0 +1,296 @@
+#include "AnimationPlayer.hpp"
+
+#include <format>
+
+namespace
+{
+    // Same fallback browsers use for frames that don't specify a delay
+    constexpr int DEFAULT_FRAME_DELAY_MS = 100;
+    // How soon a frame the decoder hasn't finished yet is looked for again
+    constexpr int DECODER_RETRY_MS = 4;
+
+    double averageMs(const std::chrono::microseconds total, const size_t count)
+    {
+        return count == 0 ? 0.0 : static_cast<double>(total.count()) / 1000.0 / static_cast<double>(count);
+    }
+}
+
+AnimationPlayer::AnimationPlayer(
+    std::shared_ptr<CachedAnimation> animation,
+    CachedMediaProxy& proxy,
+    DecodeQueue& loadQueue,
+    std::unique_ptr<DecodeAheadDecoder> decoder,
+    QObject* parent)
+    : QObject(parent)
+    , _animation(std::move(animation))
+    , _proxy(proxy)
+    , _loadQueue(loadQueue)
+    , _decoder(std::move(decoder))
+{
+    _timer = new QTimer(this);
+    _timer->setSingleShot(true);
+    _timer->setTimerType(Qt::PreciseTimer);
+    connect(_timer, &QTimer::timeout, this, [this] { advance(); });
+}
+
+void AnimationPlayer::start()
+{
+    // Frames left over from an interrupted first loop can't be resumed from, the decoder starts at frame 0
+    if (!_animation->isComplete())
+    {
+        _proxy.discardAnimationFrames(*_animation);
+        if (!_decoder && !_openedDecoder.valid())
+        {
+            openDecoder();
+        }
+    }
+
+    _running = true;
+    _currentFrame = -1;
+    _deadline = std::chrono::steady_clock::now();
+    _lastFrameTime.reset();
+    advance();
+}
+
+void AnimationPlayer::stop()
+{
+    _running = false;
+    _timer->stop();
+    _lastFrameTime.reset();
+}
+
+void AnimationPlayer::setSpeed(const int percent)
+{
+    _speed = std::max(0, percent);
+    if (_running && _speed > 0 && !_timer->isActive())
+    {
+        _deadline = std::chrono::steady_clock::now();
+        _lastFrameTime.reset();
+        scheduleNextFrame();
+    }
+}
+
+int AnimationPlayer::frameCount() const
+{
+    if (_animation->isComplete())
+    {
+        return static_cast<int>(_animation->frames().size());
+    }
+    return _decoder ? _decoder->frameCount() : 0;
+}
+
+void AnimationPlayer::openDecoder()
+{
+    // Opening reads the file, all of it for APNG, so it happens on the load queue instead of between two frames.
+    // The job only holds the promise, a player destroyed meanwhile leaves nothing behind for it to touch.
+    auto promise = std::make_shared<std::promise<std::unique_ptr<DecodeAheadDecoder>>>();
+    _openedDecoder = promise->get_future();
+    _loadQueue.push(
+        "animation",
+        DecodePriority::Current,
+        [promise, path = _animation->path()] { promise->set_value(openAnimationDecoder(path)); },
+        [promise] { promise->set_value(nullptr); });
+}
+
+bool AnimationPlayer::takeOpenedDecoder()
+{
+    if (!_openedDecoder.valid())
+    {
+        return false;
+    }
+    if (_openedDecoder.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        retryLater();
+        return false;
+    }
+
+    // The previous loop's last frame stays current until the new loop's first one is ready
+    _decoder = _openedDecoder.get();
+    _currentFrame = -1;
+    return _decoder != nullptr;
+}
+
+void AnimationPlayer::advance()
+{
+    if (_animation->isComplete())
+    {
+        const auto& frames = _animation->frames();
+        _currentFrame = (_currentFrame + 1) % static_cast<int>(frames.size());
+        _currentImage = frames[_currentFrame].image;
+        _currentDelay = frames[_currentFrame].delay;
+    }
+    else if (!readNextFrame())
+    {
+        return;
+    }
+
+    recordFrameShown();
+    emit frameChanged(_currentFrame);
+
+    if (!_animation->isComplete() || _animation->frames().size() > 1)
+    {
+        scheduleNextFrame();
+    }
+}
+
+bool AnimationPlayer::readNextFrame()
+{
+    if (!_decoder && !takeOpenedDecoder())
+    {
+        return false;
+    }
+
+    auto frame = _decoder->next();
+    if (!frame)
+    {
+        if (!_decoder->isFinished())
+        {
+            // The decoder fell behind playback, the frame is shown late instead of stalling the GUI thread
+            retryLater();
+            return false;
+        }
+
+        // End of a loop: if every frame of it was retained, later loops replay from memory
+        if (!_animation->isStreaming() && _animation->frames().size() == static_cast<size_t>(_currentFrame + 1))
+        {
+            _animation->markComplete();
+            _decoder.reset();
+            _currentFrame = -1;
+            if (!_animation->isComplete())
+            {
+                return false;
+            }
+
+            const auto& first = _animation->frames().front();
+            _currentFrame = 0;
+            _currentImage = first.image;
+            _currentDelay = first.delay;
+            return true;
+        }
+
+        // A loop that didn't produce a single frame would only fail the same way again
+        _decoder.reset();
+        if (_currentFrame < 0)
+        {
+            return false;
+        }
+
+        openDecoder();
+        retryLater();
+        return false;
+    }
+
+    ++_currentFrame;
+    _currentImage = frame->image;
+    _currentDelay = frame->delay;
+    _proxy.storeAnimationFrame(*_animation, std::move(*frame));
+    return true;
+}
+
+void AnimationPlayer::retryLater()
+{
+    if (_running)
+    {
+        _timer->start(DECODER_RETRY_MS);
+    }
+}
+
+void AnimationPlayer::scheduleNextFrame()
+{
+    if (!_running || _speed == 0)
+    {
+        return;
+    }
+
+    const int delay = _currentDelay > 0 ? _currentDelay : DEFAULT_FRAME_DELAY_MS;
+    _expectedInterval = std::chrono::milliseconds(delay * 100 / _speed);
+
+    // A player that fell behind skips ahead instead of bursting frames to catch up
+    const auto now = std::chrono::steady_clock::now();
+    _deadline = std::max(_deadline + _expectedInterval, now);
+    _timer->start(static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(_deadline - now).count()));
+}
+
+void AnimationPlayer::recordFrameShown()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (_lastFrameTime)
+    {
+        const auto interval = std::chrono::duration_cast<std::chrono::microseconds>(now - *_lastFrameTime);
+        const auto expected = std::chrono::duration_cast<std::chrono::microseconds>(_expectedInterval);
+        ++_timing.frames;
+        _timing.totalInterval += interval;
+        _timing.totalExpected += expected;
+        if (interval > expected + expected / 4)
+        {
+            ++_timing.lateFrames;
+        }
+    }
+    _lastFrameTime = now;
+}
+
+QPixmap AnimationPlayer::renderedFrame(const RenderParameters& parameters, const RenderQuality quality)
+{
+    if (_currentFrame < 0 || _currentImage.isNull())
+    {
+        return {};
+    }
+
+    if (parameters != _renderedParameters)
+    {
+        releaseRenderedFrames();
+        _renderedParameters = parameters;
+    }
+
+    const auto index = static_cast<size_t>(_currentFrame);
+    if (index < _renderedFrames.size() && !_renderedFrames[index].isNull())
+    {
+        return _renderedFrames[index];
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    QPixmap pixmap = QPixmap::fromImage(renderImage(_currentImage, parameters, quality));
+    ++_timing.renders;
+    _timing.totalRenderTime +=
+        std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    // Fast renderings are only shown until the smooth pass replaces them
+    const auto bytes = static_cast<size_t>(pixmap.width()) * pixmap.height() * 4;
+    if (quality == RenderQuality::Smooth && _renderedBytes + bytes <= _renderBudget)
+    {
+        if (index >= _renderedFrames.size())
+        {
+            _renderedFrames.resize(std::max(index + 1, static_cast<size_t>(frameCount())));
+        }
+        _renderedFrames[index] = pixmap;
+        _renderedBytes += bytes;
+    }
+    return pixmap;
+}
+
+void AnimationPlayer::setRenderBudget(const size_t bytes)
+{
+    _renderBudget = bytes;
+    if (_renderedBytes > _renderBudget)
+    {
+        releaseRenderedFrames();
+    }
+}
+
+void AnimationPlayer::releaseRenderedFrames()
+{
+    _renderedFrames.clear();
+    _renderedBytes = 0;
+}
+
+std::string AnimationPlayer::frameTimingString() const
+{
+    return std::format(
+        "Animation: {} frames every {:.1f} ms (file asks {:.1f} ms), {} late, render {:.2f} ms over {} frames",
+        _timing.frames,
+        averageMs(_timing.totalInterval, _timing.frames),
+        averageMs(_timing.totalExpected, _timing.frames),
+        _timing.lateFrames,
+        averageMs(_timing.totalRenderTime, _timing.renders),
+        _timing.renders);
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <QImage>
+#include <QObject>
+#include <QPixmap>
+#include <QTimer>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "AnimationDecoder.hpp"
+#include "CachedMediaProxy.hpp"
+#include "DecodeQueue.hpp"
+
+// Pacing of shown frames against the delays the file asks for
+struct FrameTiming
+{
+    size_t frames = 0;
+    // Shown more than a quarter later than their delay asked for
+    size_t lateFrames = 0;
+    std::chrono::microseconds totalInterval = {};
+    std::chrono::microseconds totalExpected = {};
+    size_t renders = 0;
+    std::chrono::microseconds totalRenderTime = {};
+};
+
+// Plays a CachedAnimation, decoding the first loop from the file ahead of playback and replaying retained frames
+// afterwards
+class AnimationPlayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // A decoder opened ahead of time is used for the first loop instead of opening one in start(). Decoders are
+    // opened on `loadQueue`, which must outlive the player's pending jobs.
+    AnimationPlayer(
+        std::shared_ptr<CachedAnimation> animation,
+        CachedMediaProxy& proxy,
+        DecodeQueue& loadQueue,
+        std::unique_ptr<DecodeAheadDecoder> decoder = nullptr,
+        QObject* parent = nullptr);
+
+    void start();
+    void stop();
+
+    int speed() const { return _speed; }
+    void setSpeed(int percent);
+    int frameCount() const;
+    const QImage& currentImage() const { return _currentImage; }
+
+    // Current frame cropped and scaled for display. Smooth renderings are kept per frame within the render budget,
+    // so later loops with the same parameters only swap pixmaps.
+    QPixmap renderedFrame(const RenderParameters& parameters, RenderQuality quality);
+    void setRenderBudget(size_t bytes);
+    size_t renderedBytes() const { return _renderedBytes; }
+    void releaseRenderedFrames();
+    const FrameTiming& frameTiming() const { return _timing; }
+    std::string frameTimingString() const;
+
+signals:
+    void frameChanged(int frame);
+
+private:
+    std::shared_ptr<CachedAnimation> _animation;
+    CachedMediaProxy& _proxy;
+    DecodeQueue& _loadQueue;
+    std::unique_ptr<DecodeAheadDecoder> _decoder;
+    // Set while a decoder is being opened on the load queue, null if opening it was cancelled
+    std::future<std::unique_ptr<DecodeAheadDecoder>> _openedDecoder;
+    QTimer* _timer = nullptr;
+    QImage _currentImage;
+    int _currentFrame = -1;
+    int _currentDelay = 0;
+    int _speed = 100;
+    bool _running = false;
+
+    // Frames are scheduled against deadlines rather than the previous timeout, so render time doesn't add up
+    std::chrono::steady_clock::time_point _deadline;
+    std::chrono::milliseconds _expectedInterval = {};
+    std::optional<std::chrono::steady_clock::time_point> _lastFrameTime;
+    FrameTiming _timing;
+
+    // Indexed by frame, null where a frame hasn't been rendered for _renderedParameters yet
+    std::vector<QPixmap> _renderedFrames;
+    RenderParameters _renderedParameters;
+    size_t _renderedBytes = 0;
+    size_t _renderBudget = 0;
+
+    void openDecoder();
+    bool takeOpenedDecoder();
+    void advance();
+    bool readNextFrame();
+    void retryLater();
+    void scheduleNextFrame();
+    void recordFrameShown();
+};
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "ApngDecoder.hpp"
+
+#include <QFile>
+#include <QPainter>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace
+{
+    constexpr std::string_view PNG_SIGNATURE("\x89PNG\r\n\x1a\n", 8);
+    constexpr qsizetype IHDR_SIZE = 13;
+    constexpr qsizetype FCTL_SIZE = 26;
+    // Length, type and CRC around every chunk's data
+    constexpr qsizetype CHUNK_OVERHEAD = 12;
+
+    constexpr uint8_t DISPOSE_BACKGROUND = 1;
+    constexpr uint8_t DISPOSE_PREVIOUS = 2;
+    constexpr uint8_t BLEND_OVER = 1;
+
+    // Same default as browsers for a zero denominator
+    constexpr int DEFAULT_DELAY_DENOMINATOR = 100;
+
+    uint32_t readU32(const QByteArray& data, const qsizetype offset)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data.constData() + offset);
+        return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+               (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+    }
+
+    uint16_t readU16(const QByteArray& data, const qsizetype offset)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data.constData() + offset);
+        return static_cast<uint16_t>((bytes[0] << 8) | bytes[1]);
+    }
+
+    void appendU32(QByteArray& data, const uint32_t value)
+    {
+        data.append(static_cast<char>(value >> 24));
+        data.append(static_cast<char>(value >> 16));
+        data.append(static_cast<char>(value >> 8));
+        data.append(static_cast<char>(value));
+    }
+
+    uint32_t crc32(const char* data, const qsizetype size, uint32_t crc = 0)
+    {
+        static const auto TABLE = [] {
+            std::array<uint32_t, 256> table{};
+            for (uint32_t i = 0; i < table.size(); ++i)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    value = (value & 1) ? 0xEDB88320U ^ (value >> 1) : value >> 1;
+                }
+                table[i] = value;
+            }
+            return table;
+        }();
+
+        crc = ~crc;
+        for (qsizetype i = 0; i < size; ++i)
+        {
+            crc = TABLE[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void appendChunk(QByteArray& png, const char* type, const char* data, const qsizetype size)
+    {
+        appendU32(png, static_cast<uint32_t>(size));
+        png.append(type, 4);
+        png.append(data, size);
+        appendU32(png, crc32(data, size, crc32(type, 4)));
+    }
+}
+
+std::unique_ptr<ApngDecoder> ApngDecoder::open(const std::string& path)
+{
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<ApngDecoder> decoder(new ApngDecoder(file.readAll()));
+    return decoder->parse() ? std::move(decoder) : nullptr;
+}
+
+ApngDecoder::ApngDecoder(QByteArray data)
+    : _data(std::move(data))
+{
+}
+
+bool ApngDecoder::parse()
+{
+    if (!_data.startsWith(QByteArray(PNG_SIGNATURE.data(), PNG_SIGNATURE.size())))
+    {
+        return false;
+    }
+
+    bool animated = false;
+    bool seenImageData = false;
+    qsizetype position = PNG_SIGNATURE.size();
+    while (position + CHUNK_OVERHEAD <= _data.size())
+    {
+        const auto length = static_cast<qsizetype>(readU32(_data, position));
+        const QByteArray type = _data.mid(position + 4, 4);
+        const qsizetype payload = position + 8;
+        if (length > _data.size() - payload - 4)
+        {
+            break;
+        }
+
+        if (type == "IHDR" && length == IHDR_SIZE)
+        {
+            _header = _data.mid(payload, length);
+            _size = { static_cast<int>(readU32(_data, payload)), static_cast<int>(readU32(_data, payload + 4)) };
+        }
+        else if (type == "acTL")
+        {
+            animated = true;
+        }
+        else if (type == "fcTL" && length >= FCTL_SIZE)
+        {
+            const int denominator = readU16(_data, payload + 22);
+            _frames.push_back({
+                .rect = QRect(
+                    static_cast<int>(readU32(_data, payload + 12)),
+                    static_cast<int>(readU32(_data, payload + 16)),
+                    static_cast<int>(readU32(_data, payload + 4)),
+                    static_cast<int>(readU32(_data, payload + 8))),
+                .delay = readU16(_data, payload + 20) * 1000 /
+                         (denominator == 0 ? DEFAULT_DELAY_DENOMINATOR : denominator),
+                .dispose = static_cast<uint8_t>(_data[payload + 24]),
+                .blend = static_cast<uint8_t>(_data[payload + 25]),
+            });
+        }
+        else if (type == "IDAT")
+        {
+            // The default image is only part of the animation when a frame control precedes it
+            seenImageData = true;
+            if (!_frames.empty())
+            {
+                _frames.back().data.push_back({ .offset = payload, .length = length });
+            }
+        }
+        else if (type == "fdAT" && length > 4 && !_frames.empty())
+        {
+            _frames.back().data.push_back({ .offset = payload + 4, .length = length - 4 });
+        }
+        else if (type == "IEND")
+        {
+            break;
+        }
+        else if (!seenImageData && type != "fcTL")
+        {
+            _sharedChunks.append(_data.mid(position, length + CHUNK_OVERHEAD));
+        }
+
+        position = payload + length + 4;
+    }
+
+    const QRect canvas(QPoint(0, 0), _size);
+    const bool framesValid = std::ranges::all_of(_frames, [&](const FrameControl& frame) {
+        return !frame.data.empty() && !frame.rect.isEmpty() && canvas.contains(frame.rect);
+    });
+    return animated && !_header.isEmpty() && !_frames.empty() && framesValid;
+}
+
+std::optional<AnimationFrame> ApngDecoder::next()
+{
+    if (_nextFrame >= _frames.size())
+    {
+        return std::nullopt;
+    }
+
+    const auto& frame = _frames[_nextFrame];
+    const QImage image = decodeFrame(frame);
+    if (image.isNull())
+    {
+        return std::nullopt;
+    }
+
+    if (_nextFrame == 0)
+    {
+        _canvas = QImage(_size, QImage::Format_ARGB32_Premultiplied);
+        _canvas.fill(Qt::transparent);
+    }
+
+    const QImage previous = frame.dispose == DISPOSE_PREVIOUS ? _canvas.copy() : QImage();
+    {
+        QPainter painter(&_canvas);
+        painter.setCompositionMode(
+            frame.blend == BLEND_OVER ? QPainter::CompositionMode_SourceOver : QPainter::CompositionMode_Source);
+        painter.drawImage(frame.rect.topLeft(), image);
+    }
+
+    // Shares the canvas until disposal or the next frame modifies it
+    AnimationFrame result{ .image = _canvas, .delay = frame.delay };
+
+    // A first frame can't restore what came before it, it is cleared instead
+    if (frame.dispose == DISPOSE_BACKGROUND || (frame.dispose == DISPOSE_PREVIOUS && _nextFrame == 0))
+    {
+        QPainter painter(&_canvas);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.fillRect(frame.rect, Qt::transparent);
+    }
+    else if (frame.dispose == DISPOSE_PREVIOUS)
+    {
+        _canvas = previous;
+    }
+
+    ++_nextFrame;
+    return result;
+}
+
+QImage ApngDecoder::decodeFrame(const FrameControl& frame) const
+{
+    // Same header as the image, but with the frame's dimensions
+    QByteArray header;
+    appendU32(header, static_cast<uint32_t>(frame.rect.width()));
+    appendU32(header, static_cast<uint32_t>(frame.rect.height()));
+    header.append(_header.mid(8));
+
+    QByteArray png(PNG_SIGNATURE.data(), PNG_SIGNATURE.size());
+    appendChunk(png, "IHDR", header.constData(), header.size());
+    png.append(_sharedChunks);
+    for (const auto& slice : frame.data)
+    {
+        appendChunk(png, "IDAT", _data.constData() + slice.offset, slice.length);
+    }
+    appendChunk(png, "IEND", nullptr, 0);
+
+    return QImage::fromData(png, "PNG").convertToFormat(QImage::Format_ARGB32_Premultiplied);
+}
\ No newline at end of file
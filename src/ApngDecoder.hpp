@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AnimationDecoder.hpp"
+
+// Animated PNGs decoded in-process. Every frame is rebuilt into a standalone PNG for Qt's decoder, then
+// composited onto the canvas following its blend and dispose operations.
+class ApngDecoder : public AnimationDecoder
+{
+public:
+    // Null if the file isn't an animated PNG or its animation chunks are malformed
+    static std::unique_ptr<ApngDecoder> open(const std::string& path);
+
+    std::optional<AnimationFrame> next() override;
+    int frameCount() const override { return static_cast<int>(_frames.size()); }
+
+private:
+    struct Slice
+    {
+        qsizetype offset = 0;
+        qsizetype length = 0;
+    };
+
+    struct FrameControl
+    {
+        QRect rect;
+        int delay = 0;
+        uint8_t dispose = 0;
+        uint8_t blend = 0;
+        // Compressed image data of the frame within _data, without fdAT sequence numbers
+        std::vector<Slice> data;
+    };
+
+    QByteArray _data;
+    QByteArray _header;
+    // Chunks before the first IDAT that every frame needs too (palette, transparency, colour space)
+    QByteArray _sharedChunks;
+    QSize _size;
+    std::vector<FrameControl> _frames;
+    size_t _nextFrame = 0;
+    QImage _canvas;
+
+    explicit ApngDecoder(QByteArray data);
+
+    bool parse();
+    QImage decodeFrame(const FrameControl& frame) const;
+};
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "CacheStatistics.hpp"
+
+#include <algorithm>
+#include <format>
+#include <sstream>
+
+// Percentiles are computed over the most recent decodes of each format
+constexpr size_t MAX_DECODE_SAMPLES = 512;
+
+void CacheStatistics::recordDecode(const std::string& format, const std::chrono::microseconds time)
+{
+    std::lock_guard lock(_decodeMutex);
+    auto& samples = _decodeTimes[format.empty() ? "unknown" : format];
+
+    const float ms = static_cast<float>(time.count()) / 1000.0f;
+    if (samples.milliseconds.size() < MAX_DECODE_SAMPLES)
+    {
+        samples.milliseconds.push_back(ms);
+    }
+    else
+    {
+        samples.milliseconds[samples.next] = ms;
+    }
+    samples.next = (samples.next + 1) % MAX_DECODE_SAMPLES;
+    ++samples.total;
+}
+
+std::string CacheStatistics::toString() const
+{
+    const size_t hits = _hits;
+    const size_t misses = _misses;
+    const size_t inFlightWaits = _inFlightWaits;
+    const size_t lookups = hits + misses + inFlightWaits;
+
+    std::stringstream sstr;
+    sstr << std::format(
+        "Lookups: {} (hits {}, in-flight waits {}, misses {}, hit rate {:.1f}%)\n",
+        lookups,
+        hits,
+        inFlightWaits,
+        misses,
+        lookups == 0 ? 0.0 : 100.0 * static_cast<double>(hits) / static_cast<double>(lookups));
+    sstr << std::format(
+        "Prefetches: {}, cancelled: {}, evictions: {}\n",
+        _prefetches.load(),
+        _cancellations.load(),
+        _evictions.load());
+    sstr << std::format("Encoded tier: {} decodes from memory, {} from disk\n", _encodedHits.load(), _encodedReads.load());
+
+    std::lock_guard lock(_decodeMutex);
+    for (const auto& [format, samples] : _decodeTimes)
+    {
+        auto sorted = samples.milliseconds;
+        std::ranges::sort(sorted);
+        const auto percentile = [&sorted](const double p) {
+            return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())))];
+        };
+        sstr << std::format(
+            "Decode {:<5} n={:<5} p50={:.1f}ms p90={:.1f}ms p99={:.1f}ms max={:.1f}ms\n",
+            format,
+            samples.total,
+            percentile(0.5),
+            percentile(0.9),
+            percentile(0.99),
+            sorted.back());
+    }
+
+    return sstr.str();
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Counters describing how well the media cache performs, safe to update from decode threads
+class CacheStatistics
+{
+public:
+    void recordHit() { ++_hits; }
+    void recordMiss() { ++_misses; }
+    void recordInFlightWait() { ++_inFlightWaits; }
+    void recordEviction() { ++_evictions; }
+    void recordPrefetch() { ++_prefetches; }
+    void recordCancellations(const size_t count) { _cancellations += count; }
+    void recordEncodedHit() { ++_encodedHits; }
+    void recordEncodedRead() { ++_encodedReads; }
+    void recordDecode(const std::string& format, std::chrono::microseconds time);
+
+    std::string toString() const;
+
+private:
+    struct DecodeSamples
+    {
+        std::vector<float> milliseconds;
+        size_t next = 0;
+        size_t total = 0;
+    };
+
+    std::atomic_size_t _hits = 0;
+    std::atomic_size_t _misses = 0;
+    std::atomic_size_t _inFlightWaits = 0;
+    std::atomic_size_t _evictions = 0;
+    std::atomic_size_t _prefetches = 0;
+    std::atomic_size_t _cancellations = 0;
+    std::atomic_size_t _encodedHits = 0;
+    std::atomic_size_t _encodedReads = 0;
+
+    mutable std::mutex _decodeMutex;
+    std::map<std::string, DecodeSamples> _decodeTimes;
+};
\ No newline at end of file
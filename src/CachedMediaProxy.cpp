@@ -1,103 +1,855 @@
 #include "CachedMediaProxy.hpp"
 
+#include <QBuffer>
+#include <QImageReader>
+
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
+#include <format>
 #include <future>
+#include <ranges>
+#include <thread>
+#include <unordered_set>
 
 #include "Utils.hpp"
 
-CachedMediaProxy::CachedMediaProxy(const size_t maxMB)
+#ifdef __GLIBC__
+    #include <malloc.h>
+#endif
+
+namespace
+{
+    constexpr size_t BYTES_PER_PIXEL = 4;
+
+    // Full resolution decodes of reduced images live next to them under a key no real path can produce
+    std::string fullResolutionKey(const std::string& path)
+    {
+        return path + '\0' + "full";
+    }
+
+    std::string tileKey(const std::string& path, const TileKey& tile)
+    {
+        return path + '\0' + std::format("tile:{}:{}:{}", tile.level, tile.column, tile.row);
+    }
+
+    CachedImage decodeImage(
+        const std::string& path,
+        const std::shared_ptr<const QByteArray>& bytes,
+        const DecodeTarget& target,
+        std::string& format)
+    {
+        if (!bytes)
+        {
+            format.clear();
+            return { path, 0, QImage() };
+        }
+
+        // The extension is only a hint, the reader still detects the format from content if it is wrong
+        QBuffer buffer;
+        buffer.setData(*bytes);
+        buffer.open(QIODevice::ReadOnly);
+        const auto extension = std::filesystem::path(path).extension().string();
+        QImageReader reader(&buffer, QByteArray::fromStdString(extension.empty() ? "" : extension.substr(1)));
+        format = reader.format().toStdString();
+        const QSize originalSize = reader.size();
+        const auto now = std::chrono::system_clock::now().time_since_epoch().count();
+
+        if (target.tile)
+        {
+            // Plugins supporting clip rects (e.g. JPEG) stop decoding past the tile's last row
+            const QSize scaledSize = levelSize(originalSize, target.tile->level);
+            if (scaledSize != originalSize)
+            {
+                reader.setScaledSize(scaledSize);
+            }
+            reader.setScaledClipRect(tileRect(originalSize, *target.tile));
+            return { path, now, reader.read() };
+        }
+
+        // Formats that can't decode a region would go through the whole image for every tile
+        const bool tiled = !target.fullResolution && isTiledSize(originalSize) &&
+                           reader.supportsOption(QImageIOHandler::ClipRect);
+        QSize boundingSize = target.boundingSize;
+        if (tiled)
+        {
+            const QSize overviewSize(TILED_OVERVIEW_SIZE, TILED_OVERVIEW_SIZE);
+            boundingSize = boundingSize.isValid() ? boundingSize.boundedTo(overviewSize) : overviewSize;
+        }
+
+        QSize decodedSize = originalSize;
+        if (boundingSize.isValid() && originalSize.isValid() &&
+            (originalSize.width() > boundingSize.width() || originalSize.height() > boundingSize.height()))
+        {
+            decodedSize = originalSize.scaled(boundingSize, Qt::KeepAspectRatio);
+        }
+
+        const auto decodedPixels = static_cast<double>(decodedSize.width()) * decodedSize.height();
+        if (target.maxPixels > 0 && decodedPixels > static_cast<double>(target.maxPixels))
+        {
+            decodedSize = (decodedSize * std::sqrt(static_cast<double>(target.maxPixels) / decodedPixels))
+                              .expandedTo(QSize(1, 1));
+        }
+
+        if (decodedSize != originalSize)
+        {
+            // Lets the format plugin decode at reduced scale directly (e.g. DCT scaling for JPEG)
+            reader.setScaledSize(decodedSize);
+        }
+        return { path, now, reader.read(), originalSize, tiled };
+    }
+
+    // Done on the decode thread so that showing the image later only needs a pixmap upload
+    void preRender(CachedImage& cachedImage, const RenderParameters& parameters)
+    {
+        const auto image = cachedImage.image();
+        if (!parameters.viewportSize.isValid() || image->isNull())
+        {
+            return;
+        }
+
+        QImage rendered = renderImage(*image, parameters);
+        rendered.convertTo(
+            rendered.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+        cachedImage.setRendered(std::move(rendered), parameters);
+    }
+
+    // Evicted images leave large holes in the heap that glibc won't hand back to the OS on its own
+    void releaseFreedMemory()
+    {
+#ifdef __GLIBC__
+        malloc_trim(0);
+#endif
+    }
+}
+
+CachedMediaProxy::CachedMediaProxy(const size_t maxMB, const size_t encodedMaxMB)
     : _maxCacheSize(maxMB * 1024 * 1024)
+    , _encodedCache(encodedMaxMB * 1024 * 1024)
+    , _decodeQueue(std::clamp(std::thread::hardware_concurrency() / 2, 2U, 6U))
+    , _readQueue(2)
 {
 }
 
-std::shared_future<CachedImage> CachedMediaProxy::getImage(const std::string& path)
+void CachedMediaProxy::setDecodeCallback(DecodeCallback callback)
+{
+    _onDecoded = std::move(callback);
+}
+
+std::shared_future<CachedImage> CachedMediaProxy::getImage(const std::string& path, const DecodePriority priority)
 {
     assert(std::filesystem::exists(path));
 
-    if (_cached_images.count(path))
+    auto& shard = shardFor(path);
     {
-        return _cached_images.at(path);
+        std::shared_lock lock(shard.mutex);
+        if (const auto it = shard.entries.find(path); it != shard.entries.end())
+        {
+            recordLookup(it->second);
+            it->second.referenced = true;
+            _decodeQueue.promote(path, priority);
+            return it->second.future;
+        }
     }
 
-    std::lock_guard lock(_mutex);
-    std::shared_future future = std::async(std::launch::async, [this, path] {
-        const auto now = std::chrono::system_clock::now().time_since_epoch().count();
-        CachedImage cachedImage(path, now, QImage(QString::fromStdString(path)));
+    return requestImage(path, path, priority, { .boundingSize = displayDecodeSize() }, false);
+}
+
+std::shared_future<CachedImage> CachedMediaProxy::getFullImage(const std::string& path)
+{
+    assert(std::filesystem::exists(path));
 
-        _mutex.lock();
-        if (_currentCacheSize + cachedImage.getMemorySize() > _maxCacheSize)
+    {
+        auto& shard = shardFor(path);
+        std::shared_lock lock(shard.mutex);
+        if (const auto it = shard.entries.find(path);
+            it != shard.entries.end() && it->second.decoded && !it->second.reduced)
         {
-            deleteOldest();
+            recordLookup(it->second);
+            it->second.referenced = true;
+            return it->second.future;
         }
-        _currentCacheSize += cachedImage.getMemorySize();
-        _mutex.unlock();
+    }
 
-        return cachedImage;
-    });
-    _cached_images.emplace(path, future);
-    return future;
+    const auto key = fullResolutionKey(path);
+    auto& shard = shardFor(key);
+    {
+        std::shared_lock lock(shard.mutex);
+        if (const auto it = shard.entries.find(key); it != shard.entries.end())
+        {
+            recordLookup(it->second);
+            it->second.referenced = true;
+            _decodeQueue.promote(key, DecodePriority::Current);
+            return it->second.future;
+        }
+    }
+
+    // A single image never takes more than half the budget, huge ones are decoded at reduced scale instead
+    const DecodeTarget target{ .maxPixels = _maxCacheSize / 2 / BYTES_PER_PIXEL, .fullResolution = true };
+    return requestImage(key, path, DecodePriority::Current, target, false);
+}
+
+std::shared_future<CachedImage> CachedMediaProxy::getTile(const std::string& path, const TileKey& tile)
+{
+    const auto key = tileKey(path, tile);
+    auto& shard = shardFor(key);
+    {
+        std::shared_lock lock(shard.mutex);
+        if (const auto it = shard.entries.find(key); it != shard.entries.end())
+        {
+            recordLookup(it->second);
+            it->second.referenced = true;
+            _decodeQueue.promote(key, DecodePriority::Current);
+            return it->second.future;
+        }
+    }
+
+    return requestImage(key, path, DecodePriority::Current, { .tile = tile }, false);
+}
+
+std::shared_ptr<CachedAnimation> CachedMediaProxy::getAnimation(const std::string& path)
+{
+    std::lock_guard lock(_animationMutex);
+    if (const auto it = _animations.find(path); it != _animations.end())
+    {
+        if (it->second.animation->isComplete())
+        {
+            _statistics.recordHit();
+        }
+        else
+        {
+            _statistics.recordMiss();
+        }
+        _animationLru.splice(_animationLru.begin(), _animationLru, it->second.lruIterator);
+        return it->second.animation;
+    }
+
+    _statistics.recordMiss();
+    _animationLru.push_front(path);
+    auto animation = std::make_shared<CachedAnimation>(path);
+    _animations.emplace(path, AnimationEntry{ .animation = animation, .lruIterator = _animationLru.begin() });
+    return animation;
 }
 
-std::shared_ptr<QMovie> CachedMediaProxy::getAnimation(const std::string& path)
+void CachedMediaProxy::storeAnimationFrame(CachedAnimation& animation, AnimationFrame&& frame)
 {
-    return std::make_shared<QMovie>(QString::fromStdString(path));
+    {
+        std::lock_guard lock(_animationMutex);
+        const auto it = _animations.find(animation.path());
+        if (animation.isStreaming() || it == _animations.end() || it->second.animation.get() != &animation)
+        {
+            return;
+        }
+
+        // A single animation may take up to half the budget, past that it is streamed instead
+        const auto frameSize = static_cast<size_t>(frame.image.sizeInBytes());
+        if (animation.getMemorySize() + frameSize > _maxCacheSize / 2)
+        {
+            _currentCacheSize -= animation.dropFrames();
+            animation.setStreaming();
+            return;
+        }
+
+        animation.appendFrame(std::move(frame));
+        _currentCacheSize += frameSize;
+    }
+
+    evictUntilFits();
 }
 
-void CachedMediaProxy::preCacheImage(const std::string& path)
+void CachedMediaProxy::discardAnimationFrames(CachedAnimation& animation)
+{
+    std::lock_guard lock(_animationMutex);
+    const size_t size = animation.dropFrames();
+    // Evicted animations were already subtracted from the total when they left the index
+    if (const auto it = _animations.find(animation.path());
+        it != _animations.end() && it->second.animation.get() == &animation)
+    {
+        _currentCacheSize -= size;
+    }
+}
+
+void CachedMediaProxy::preCacheImage(const std::string& path, const DecodePriority priority)
 {
     if (!isImage(path))
     {
         return;
     }
 
-    if (_cached_images.contains(path))
+    auto& shard = shardFor(path);
     {
-        return;
+        std::shared_lock lock(shard.mutex);
+        if (const auto it = shard.entries.find(path); it != shard.entries.end())
+        {
+            if (!it->second.displayed)
+            {
+                _decodeQueue.setPriority(path, priority);
+            }
+            return;
+        }
+    }
+
+    requestImage(path, path, priority, { .boundingSize = displayDecodeSize() }, true);
+}
+
+void CachedMediaProxy::cancelPrecacheExcept(const std::vector<std::string>& paths)
+{
+    std::unordered_set<std::string> keep(paths.begin(), paths.end());
+    const auto displayed = displayedPath();
+    keep.insert(displayed);
+    keep.insert(fullResolutionKey(displayed));
+    // Tiles are only ever requested for the displayed image, by the view itself
+    for (auto& shard : _shards)
+    {
+        std::shared_lock lock(shard.mutex);
+        for (const auto& [key, entry] : shard.entries)
+        {
+            if (!entry.decoded && entry.path == displayed)
+            {
+                keep.insert(key);
+            }
+        }
+    }
+
+    const auto cancelled = _decodeQueue.cancelAllExcept(keep);
+    for (const auto& key : cancelled)
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        // A cancelled job never decoded anything, so a decoded entry under its key is not the one it belonged to
+        if (const auto it = shard.entries.find(key); it != shard.entries.end() && !it->second.decoded)
+        {
+            shard.entries.erase(it);
+        }
+    }
+    _statistics.recordCancellations(cancelled.size());
+}
+
+void CachedMediaProxy::preloadEncoded(const std::vector<std::string>& paths)
+{
+    _readQueue.cancelAllExcept({ paths.begin(), paths.end() });
+
+    // Equal priorities run newest first, so the nearest paths are queued last.
+    // Classifying touches the file, so it is left to the read job instead of running here on every keypress.
+    for (const auto& path : paths | std::views::reverse)
+    {
+        if (!_encodedCache.contains(path) && hasMediaExtension(path))
+        {
+            _readQueue.push(
+                path,
+                DecodePriority::Far,
+                [this, path] {
+                    if (isImage(path))
+                    {
+                        _encodedCache.load(path);
+                    }
+                },
+                {});
+        }
     }
+}
 
-    std::lock_guard lock(_mutex);
+size_t CachedMediaProxy::affordableEncodedEntries()
+{
+    return _encodedCache.affordableEntries();
+}
 
-    std::shared_future future = std::async(std::launch::async, [&]() -> CachedImage {
-        QImage image(QString::fromStdString(path));
-        const time_t now = std::chrono::system_clock::now().time_since_epoch().count();
-        return { path, now, std::move(image) };
-    });
+void CachedMediaProxy::setDisplayedImage(const std::string& path)
+{
+    std::string previous;
+    {
+        std::lock_guard lock(_stateMutex);
+        if (path == _displayedPath)
+        {
+            return;
+        }
+        previous = std::exchange(_displayedPath, path);
+    }
 
-    _cached_images.emplace(path, std::move(future));
+    // Entries requested concurrently see the new path before their shard lock is released, so none is missed here
+    setPinned(previous, false);
+    setPinned(path, true);
 }
 
 void CachedMediaProxy::notifyBigJump()
 {
-    clear();
+    // Decoded images stay and age out through eviction, so jumping back is still instant.
+    // Only queued work for the region being left is dropped.
+    cancelPrecacheExcept({});
+}
+
+void CachedMediaProxy::setDisplayDecodeSize(const QSize size)
+{
+    std::lock_guard lock(_stateMutex);
+    _displayDecodeSize = size;
+}
+
+void CachedMediaProxy::setRenderViewport(const QSize viewportSize, const qreal devicePixelRatio)
+{
+    std::lock_guard lock(_stateMutex);
+    _renderParameters = { .viewportSize = viewportSize, .devicePixelRatio = devicePixelRatio };
+}
+
+CacheUsage CachedMediaProxy::usage()
+{
+    size_t entryCount = 0;
+    for (auto& shard : _shards)
+    {
+        std::shared_lock lock(shard.mutex);
+        entryCount += shard.entries.size();
+    }
+
+    {
+        std::lock_guard lock(_animationMutex);
+        entryCount += _animations.size();
+    }
+
+    std::lock_guard lock(_stateMutex);
+    return { .currentSize = _currentCacheSize,
+             .maxSize = _maxCacheSize,
+             .entryCount = entryCount,
+             .averageEntrySize = static_cast<size_t>(_averageEntrySize),
+             .averageDecodeTime = std::chrono::milliseconds(static_cast<int64_t>(_averageDecodeMs)) };
+}
+
+void CachedMediaProxy::setMaxCacheSize(const size_t bytes)
+{
+    const bool shrunk = bytes < _currentCacheSize;
+    _maxCacheSize = bytes;
+    evictUntilFits();
+
+    if (shrunk)
+    {
+        releaseFreedMemory();
+    }
+}
+
+void CachedMediaProxy::setMaxEncodedCacheSize(const size_t bytes)
+{
+    const bool shrunk = bytes < _encodedCache.currentSize();
+    _encodedCache.setMaxSize(bytes);
+
+    if (shrunk)
+    {
+        releaseFreedMemory();
+    }
+}
+
+void CachedMediaProxy::trim()
+{
+    cancelPrecacheExcept({});
+    for (auto& shard : _shards)
+    {
+        std::unique_lock lock(shard.mutex);
+        while (!shard.clock.empty())
+        {
+            evict(shard, shard.clock.begin());
+        }
+    }
+
+    const auto displayed = displayedPath();
+    while (evictOneAnimation(displayed))
+    {
+    }
+    _readQueue.cancelAll();
+    _encodedCache.clear();
+    releaseFreedMemory();
+}
+
+void CachedMediaProxy::invalidate(const std::string& path)
+{
+    _readQueue.cancel(path);
+    _encodedCache.remove(path);
+
+    // Full resolution decodes and tiles live under keys derived from the path, spread over every shard
+    const std::string derivedPrefix = path + '\0';
+    for (auto& shard : _shards)
+    {
+        std::unique_lock lock(shard.mutex);
+        for (auto it = shard.entries.begin(); it != shard.entries.end();)
+        {
+            if (it->first != path && !it->first.starts_with(derivedPrefix))
+            {
+                ++it;
+                continue;
+            }
+
+            auto& entry = it->second;
+            if (!entry.decoded)
+            {
+                // A decode already running reports back to an entry that no longer exists and is dropped
+                _decodeQueue.cancel(it->first);
+            }
+            else
+            {
+                _currentCacheSize -= entry.memorySize;
+                if (!entry.displayed)
+                {
+                    if (shard.hand == entry.clockIterator)
+                    {
+                        ++shard.hand;
+                    }
+                    shard.clock.erase(entry.clockIterator);
+                }
+            }
+            it = shard.entries.erase(it);
+        }
+    }
+
+    std::lock_guard lock(_animationMutex);
+    if (const auto it = _animations.find(path); it != _animations.end())
+    {
+        _currentCacheSize -= it->second.animation->getMemorySize();
+        _animationLru.erase(it->second.lruIterator);
+        _animations.erase(it);
+    }
 }
 
 void CachedMediaProxy::clear()
 {
-    std::lock_guard lock(_mutex);
-    _cached_images.clear();
-    _currentCacheSize = 0;
+    _statistics.recordCancellations(_decodeQueue.cancelAllExcept({}).size());
+    _readQueue.cancelAll();
+    _encodedCache.clear();
+    for (auto& shard : _shards)
+    {
+        std::unique_lock lock(shard.mutex);
+        for (const auto& entry : shard.entries | std::views::values)
+        {
+            _currentCacheSize -= entry.memorySize;
+        }
+        shard.entries.clear();
+        shard.clock.clear();
+        shard.hand = shard.clock.end();
+    }
+
+    std::lock_guard lock(_animationMutex);
+    for (const auto& entry : _animations | std::views::values)
+    {
+        _currentCacheSize -= entry.animation->getMemorySize();
+    }
+    _animations.clear();
+    _animationLru.clear();
+}
+
+CachedMediaProxy::Shard& CachedMediaProxy::shardFor(const std::string& key)
+{
+    return _shards[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
+
+std::string CachedMediaProxy::displayedPath()
+{
+    std::lock_guard lock(_stateMutex);
+    return _displayedPath;
+}
+
+QSize CachedMediaProxy::displayDecodeSize()
+{
+    std::lock_guard lock(_stateMutex);
+    return _displayDecodeSize;
+}
+
+RenderParameters CachedMediaProxy::renderParameters()
+{
+    std::lock_guard lock(_stateMutex);
+    return _renderParameters;
+}
+
+std::shared_ptr<const QByteArray> CachedMediaProxy::loadEncoded(const std::string& path)
+{
+    if (auto bytes = _encodedCache.find(path))
+    {
+        _statistics.recordEncodedHit();
+        return bytes;
+    }
+
+    _statistics.recordEncodedRead();
+    return _encodedCache.load(path);
+}
+
+std::shared_future<CachedImage> CachedMediaProxy::requestImage(
+    const std::string& key,
+    const std::string& path,
+    const DecodePriority priority,
+    const DecodeTarget& target,
+    const bool prefetch)
+{
+    auto& shard = shardFor(key);
+    std::unique_lock lock(shard.mutex);
+
+    // Another thread may have requested the same key between the shared lookup and here
+    if (const auto it = shard.entries.find(key); it != shard.entries.end())
+    {
+        recordLookup(it->second);
+        it->second.referenced = true;
+        return it->second.future;
+    }
+
+    if (prefetch)
+    {
+        _statistics.recordPrefetch();
+    }
+    else
+    {
+        _statistics.recordMiss();
+    }
+
+    const uint64_t id = _nextEntryId++;
+    auto promise = std::make_shared<std::promise<CachedImage>>();
+    std::shared_future future = promise->get_future().share();
+    // Full resolution decodes are only requested for zoomed views, which the default rendering doesn't cover
+    const RenderParameters defaultView = key == path ? renderParameters() : RenderParameters{};
+
+    _decodeQueue.push(
+        key,
+        priority,
+        [this, key, path, target, defaultView, id, promise] {
+            const auto start = std::chrono::steady_clock::now();
+            std::string format;
+            CachedImage cachedImage = decodeImage(path, loadEncoded(path), target, format);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            _statistics.recordDecode(format, std::chrono::duration_cast<std::chrono::microseconds>(elapsed));
+            preRender(cachedImage, defaultView);
+
+            // Pyramid levels get built later on the GUI thread, their memory is charged to this entry as they appear
+            cachedImage.pyramid()->setGrowthCallback(
+                [this, key, id](const size_t bytes) { onEntryGrown(key, id, bytes); });
+
+            const auto decodeTime = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+            onImageDecoded(key, id, cachedImage.getMemorySize(), cachedImage.isReduced(), decodeTime);
+            promise->set_value(std::move(cachedImage));
+            if (_onDecoded)
+            {
+                _onDecoded();
+            }
+        },
+        [this, path, promise] {
+            promise->set_value(CachedImage(path, 0, QImage()));
+            if (_onDecoded)
+            {
+                _onDecoded();
+            }
+        });
+
+    auto& entry = shard.entries[key];
+    entry.id = id;
+    entry.path = path;
+    entry.future = future;
+    // Tiles are left unpinned, panning around a huge image would otherwise keep every tile it ever showed
+    entry.displayed = !target.tile && path == displayedPath();
+    return future;
+}
+
+void CachedMediaProxy::onImageDecoded(
+    const std::string& key,
+    const uint64_t id,
+    const size_t memorySize,
+    const bool reduced,
+    const std::chrono::milliseconds decodeTime)
+{
+    constexpr double SMOOTHING = 0.2;
+
+    if (memorySize > 0)
+    {
+        const auto size = static_cast<double>(memorySize);
+        const auto decodeMs = static_cast<double>(decodeTime.count());
+
+        std::lock_guard lock(_stateMutex);
+        const bool first = _averageEntrySize == 0;
+        _averageEntrySize = first ? size : std::lerp(_averageEntrySize, size, SMOOTHING);
+        _averageDecodeMs = first ? decodeMs : std::lerp(_averageDecodeMs, decodeMs, SMOOTHING);
+    }
+
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        const auto it = shard.entries.find(key);
+        if (it == shard.entries.end() || it->second.id != id)
+        {
+            return;
+        }
+
+        auto& entry = it->second;
+        entry.memorySize = memorySize;
+        entry.decoded = true;
+        entry.reduced = reduced;
+        entry.referenced = true;
+        _currentCacheSize += memorySize;
+        if (!entry.displayed)
+        {
+            entry.clockIterator = shard.clock.insert(shard.hand, key);
+        }
+    }
+
+    // Shards are locked one at a time while evicting, so this can't happen under the lock above
+    evictUntilFits();
+}
+
+void CachedMediaProxy::onEntryGrown(const std::string& key, const uint64_t id, const size_t bytes)
+{
+    {
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        const auto it = shard.entries.find(key);
+        if (it == shard.entries.end() || it->second.id != id || !it->second.decoded)
+        {
+            return;
+        }
+
+        it->second.memorySize += bytes;
+        _currentCacheSize += bytes;
+    }
+
+    evictUntilFits();
+}
+
+void CachedMediaProxy::recordLookup(const CacheEntry& entry)
+{
+    if (entry.decoded)
+    {
+        _statistics.recordHit();
+    }
+    else
+    {
+        _statistics.recordInFlightWait();
+    }
+}
+
+std::string CachedMediaProxy::statisticsString()
+{
+    const CacheUsage current = usage();
+    return std::format(
+               "Resident: {:.1f}/{:.1f} MB in {} entries, encoded {:.1f}/{:.1f} MB\n",
+               static_cast<double>(current.currentSize) / (1024 * 1024),
+               static_cast<double>(current.maxSize) / (1024 * 1024),
+               current.entryCount,
+               static_cast<double>(_encodedCache.currentSize()) / (1024 * 1024),
+               static_cast<double>(_encodedCache.maxSize()) / (1024 * 1024)) +
+           _statistics.toString();
+}
+
+void CachedMediaProxy::pin(Shard& shard, CacheEntry& entry)
+{
+    if (entry.decoded && !entry.displayed)
+    {
+        if (shard.hand == entry.clockIterator)
+        {
+            ++shard.hand;
+        }
+        shard.clock.erase(entry.clockIterator);
+    }
+    entry.displayed = true;
+}
+
+void CachedMediaProxy::unpin(Shard& shard, const std::string& key, CacheEntry& entry)
+{
+    if (entry.decoded && entry.displayed)
+    {
+        entry.referenced = true;
+        entry.clockIterator = shard.clock.insert(shard.hand, key);
+    }
+    entry.displayed = false;
 }
 
-void CachedMediaProxy::deleteOldest()
+void CachedMediaProxy::setPinned(const std::string& path, const bool pinned)
 {
-    const CachedImage* oldest = nullptr;
-    for (const auto& future : _cached_images | std::views::values)
+    for (const auto& key : { path, fullResolutionKey(path) })
     {
-        const auto& image = future.get();
-        if (oldest == nullptr)
+        auto& shard = shardFor(key);
+        std::unique_lock lock(shard.mutex);
+        if (const auto it = shard.entries.find(key); it != shard.entries.end())
+        {
+            if (pinned)
+            {
+                pin(shard, it->second);
+            }
+            else
+            {
+                unpin(shard, it->first, it->second);
+            }
+        }
+    }
+}
+
+void CachedMediaProxy::evictUntilFits()
+{
+    if (_currentCacheSize <= _maxCacheSize)
+    {
+        return;
+    }
+
+    // Animations that are no longer shown go first, one of them frees as much as a whole neighbourhood of images
+    const auto displayed = displayedPath();
+    while (_currentCacheSize > _maxCacheSize && evictOneAnimation(displayed))
+    {
+    }
+
+    // Shards are visited round-robin, giving up once a full round found nothing evictable.
+    // In-flight and displayed entries are never part of a clock, so they can't be picked here.
+    size_t emptyShards = 0;
+    while (_currentCacheSize > _maxCacheSize && emptyShards < SHARD_COUNT)
+    {
+        auto& shard = _shards[_evictionCursor++ % SHARD_COUNT];
+        std::unique_lock lock(shard.mutex);
+        emptyShards = evictOne(shard) ? 0 : emptyShards + 1;
+    }
+}
+
+bool CachedMediaProxy::evictOneAnimation(const std::string& displayedPath)
+{
+    std::lock_guard lock(_animationMutex);
+    for (auto it = _animationLru.rbegin(); it != _animationLru.rend(); ++it)
+    {
+        if (*it == displayedPath)
         {
-            oldest = &image;
             continue;
         }
 
-        if (image.lastAccess() < oldest->lastAccess())
+        _statistics.recordEviction();
+        const auto entry = _animations.find(*it);
+        _currentCacheSize -= entry->second.animation->getMemorySize();
+        _animations.erase(entry);
+        _animationLru.erase(std::next(it).base());
+        return true;
+    }
+    return false;
+}
+
+bool CachedMediaProxy::evictOne(Shard& shard)
+{
+    if (shard.clock.empty())
+    {
+        return false;
+    }
+
+    // Second chance: recently referenced entries get their bit cleared and are skipped once
+    while (true)
+    {
+        if (shard.hand == shard.clock.end())
+        {
+            shard.hand = shard.clock.begin();
+        }
+
+        auto& entry = shard.entries.find(*shard.hand)->second;
+        if (!entry.referenced.exchange(false))
         {
-            oldest = &image;
+            evict(shard, shard.hand);
+            return true;
         }
+        ++shard.hand;
     }
+}
 
-    assert(oldest != nullptr);
+void CachedMediaProxy::evict(Shard& shard, const std::list<std::string>::iterator clockIterator)
+{
+    _statistics.recordEviction();
+    const auto it = shard.entries.find(*clockIterator);
+    _currentCacheSize -= it->second.memorySize;
+    shard.entries.erase(it);
 
-    _currentCacheSize -= oldest->getMemorySize();
-    _cached_images.erase(oldest->path());
+    // The hand is moved off the node before erasing it, comparing against an erased iterator is undefined
+    if (shard.hand == clockIterator)
+    {
+        ++shard.hand;
+    }
+    shard.clock.erase(clockIterator);
 }
\ No newline at end of file
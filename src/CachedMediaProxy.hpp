@@ -1,20 +1,43 @@
 #pragma once
 
 #include <QImage>
-#include <QMovie>
 
+#include "AnimationDecoder.hpp"
+#include "CacheStatistics.hpp"
+#include "DecodeQueue.hpp"
+#include "EncodedCache.hpp"
+#include "MipmapPyramid.hpp"
+#include "RenderCache.hpp"
+#include "TiledImage.hpp"
+
+#include <array>
+#include <atomic>
+#include <functional>
 #include <future>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 class CachedImage
 {
 public:
-    CachedImage(std::string  path, const time_t lastAccess, QImage&& data)
+    CachedImage(
+        std::string path,
+        const time_t lastAccess,
+        QImage&& data,
+        const QSize originalSize = {},
+        const bool tiled = false)
         : _path(std::move(path))
         , _lastAccess(lastAccess)
         , _data(std::make_shared<QImage>(std::move(data)))
+        , _originalSize(originalSize.isValid() ? originalSize : _data->size())
+        , _tiled(tiled)
+        , _pyramid(std::make_shared<MipmapPyramid>(_data))
     {
     }
 
@@ -23,34 +46,230 @@ public:
 
     void ping() { _lastAccess = std::chrono::system_clock::now().time_since_epoch().count(); }
     std::shared_ptr<QImage> image() const { return _data; }
-    auto getMemorySize() const { return _data->sizeInBytes(); }
+    std::shared_ptr<MipmapPyramid> pyramid() const { return _pyramid; }
+    auto getMemorySize() const { return _data->sizeInBytes() + (_rendered ? _rendered->sizeInBytes() : 0); }
     time_t lastAccess() const { return _lastAccess; }
     const std::string& path() const { return _path; }
+    QSize originalSize() const { return _originalSize; }
+    bool isReduced() const { return _data->size() != _originalSize; }
+    // Only an overview, detail is decoded per tile through CachedMediaProxy::getTile()
+    bool isTiled() const { return _tiled; }
+
+    // Display-ready rendering of the default view, only returned if it was made for the given parameters
+    std::shared_ptr<QImage> rendered(const RenderParameters& parameters) const
+    {
+        return parameters == _renderParameters ? _rendered : nullptr;
+    }
+
+    void setRendered(QImage&& rendered, const RenderParameters& parameters)
+    {
+        _rendered = std::make_shared<QImage>(std::move(rendered));
+        _renderParameters = parameters;
+    }
 
 private:
     std::string _path;
     time_t _lastAccess;
     std::shared_ptr<QImage> _data;
+    QSize _originalSize;
+    bool _tiled;
+    std::shared_ptr<MipmapPyramid> _pyramid;
+    std::shared_ptr<QImage> _rendered;
+    RenderParameters _renderParameters;
+};
+
+// Decoded frames of an animation, filled in by AnimationPlayer on the GUI thread while it plays the first loop
+class CachedAnimation
+{
+public:
+    explicit CachedAnimation(std::string path)
+        : _path(std::move(path))
+    {
+    }
+
+    CachedAnimation(const CachedAnimation&) = delete;
+
+    const std::string& path() const { return _path; }
+    const std::vector<AnimationFrame>& frames() const { return _frames; }
+    size_t getMemorySize() const { return _memorySize; }
+    // Every frame has been retained, so playback no longer needs the file
+    bool isComplete() const { return _complete; }
+    // Too large to retain within the budget, frames are decoded again on every loop
+    bool isStreaming() const { return _streaming; }
+
+    void appendFrame(AnimationFrame&& frame)
+    {
+        _memorySize += frame.image.sizeInBytes();
+        _frames.push_back(std::move(frame));
+    }
+
+    void markComplete() { _complete = !_frames.empty(); }
+    void setStreaming() { _streaming = true; }
+
+    size_t dropFrames()
+    {
+        _frames.clear();
+        _frames.shrink_to_fit();
+        _complete = false;
+        return _memorySize.exchange(0);
+    }
+
+private:
+    std::string _path;
+    std::vector<AnimationFrame> _frames;
+    // Read by decode threads when evicting, everything else stays on the GUI thread
+    std::atomic_size_t _memorySize = 0;
+    bool _complete = false;
+    bool _streaming = false;
+};
+
+struct CacheUsage
+{
+    size_t currentSize = 0;
+    size_t maxSize = 0;
+    size_t entryCount = 0;
+    size_t averageEntrySize = 0;
+    std::chrono::milliseconds averageDecodeTime = {};
+};
+
+// Which part of an image a decode job produces, and at what size
+struct DecodeTarget
+{
+    // Decoded to fit within this size when valid
+    QSize boundingSize;
+    // Decoded pixel count is capped to this when non-zero
+    size_t maxPixels = 0;
+    // Huge images are reduced to an overview unless full resolution is asked for
+    bool fullResolution = false;
+    std::optional<TileKey> tile;
 };
 
 class CachedMediaProxy
 {
 public:
-    explicit CachedMediaProxy(size_t maxMB = 256);
+    using DecodeCallback = std::function<void()>;
+
+    explicit CachedMediaProxy(size_t maxMB = 256, size_t encodedMaxMB = 512);
+
+    // Called on the decoding thread each time a requested future becomes ready, decoded or abandoned
+    void setDecodeCallback(DecodeCallback callback);
 
-    std::shared_future<CachedImage> getImage(const std::string& path);
-    static std::shared_ptr<QMovie> getAnimation(const std::string& path);
+    std::shared_future<CachedImage> getImage(
+        const std::string& path,
+        DecodePriority priority = DecodePriority::Current);
+    std::shared_future<CachedImage> getFullImage(const std::string& path);
+    std::shared_future<CachedImage> getTile(const std::string& path, const TileKey& tile);
+    std::shared_ptr<CachedAnimation> getAnimation(const std::string& path);
+    void storeAnimationFrame(CachedAnimation& animation, AnimationFrame&& frame);
+    void discardAnimationFrames(CachedAnimation& animation);
 
-    void preCacheImage(const std::string& path);
+    void preCacheImage(const std::string& path, DecodePriority priority = DecodePriority::Far);
+    void cancelPrecacheExcept(const std::vector<std::string>& paths);
+    void preloadEncoded(const std::vector<std::string>& paths);
+    size_t affordableEncodedEntries();
+    void setDisplayedImage(const std::string& path);
     void notifyBigJump();
+    void setDisplayDecodeSize(QSize size);
+    void setRenderViewport(QSize viewportSize, qreal devicePixelRatio);
+    CacheUsage usage();
+    void setMaxCacheSize(size_t bytes);
+    void setMaxEncodedCacheSize(size_t bytes);
+    void trim();
+    std::string statisticsString();
 
+    // Drops everything derived from one file after it changed on disk
+    void invalidate(const std::string& path);
     void clear();
 
 private:
-    size_t _maxCacheSize;
-    size_t _currentCacheSize = 0;
-    std::unordered_map<std::string, std::shared_future<CachedImage>> _cached_images;
-    std::mutex _mutex;
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct CacheEntry
+    {
+        uint64_t id = 0;
+        std::string path;
+        std::shared_future<CachedImage> future;
+        size_t memorySize = 0;
+        bool decoded = false;
+        bool reduced = false;
+        bool displayed = false;
+        // Second-chance bit, set by lookups holding only a shared lock
+        std::atomic_bool referenced = true;
+        // Only valid while the entry is evictable (decoded and not displayed)
+        std::list<std::string>::iterator clockIterator;
+    };
+
+    // Lookups take the shared lock, insertions and evictions the exclusive one
+    struct Shard
+    {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, CacheEntry> entries;
+        // Evictable entries in clock order
+        std::list<std::string> clock;
+        std::list<std::string>::iterator hand = clock.end();
+    };
+
+    std::atomic_size_t _maxCacheSize;
+    std::atomic_size_t _currentCacheSize = 0;
+    std::atomic_uint64_t _nextEntryId = 0;
+    std::atomic_size_t _evictionCursor = 0;
+    std::array<Shard, SHARD_COUNT> _shards;
+
+    // Guards the state below, never held while acquiring a shard lock
+    std::mutex _stateMutex;
+    // Exponential moving averages over recent decodes
+    double _averageEntrySize = 0;
+    double _averageDecodeMs = 0;
+    std::string _displayedPath;
+    // Images are decoded to fit within this size when valid, full resolution is then fetched on demand
+    QSize _displayDecodeSize;
+    // Decoded images also get rendered for the default view of this viewport when it is valid
+    RenderParameters _renderParameters;
+
+    struct AnimationEntry
+    {
+        std::shared_ptr<CachedAnimation> animation;
+        std::list<std::string>::iterator lruIterator;
+    };
+
+    // Guards the animation index, never held while acquiring another lock
+    std::mutex _animationMutex;
+    std::unordered_map<std::string, AnimationEntry> _animations;
+    // Most recently used first
+    std::list<std::string> _animationLru;
+
+    CacheStatistics _statistics;
+    DecodeCallback _onDecoded;
+    EncodedCache _encodedCache;
+    // Declared last so that pending decodes are abandoned before the index they report to goes away
+    DecodeQueue _decodeQueue;
+    DecodeQueue _readQueue;
+
+    Shard& shardFor(const std::string& key);
+    std::string displayedPath();
+    QSize displayDecodeSize();
+    RenderParameters renderParameters();
 
-    void deleteOldest();
+    std::shared_ptr<const QByteArray> loadEncoded(const std::string& path);
+    std::shared_future<CachedImage> requestImage(
+        const std::string& key,
+        const std::string& path,
+        DecodePriority priority,
+        const DecodeTarget& target,
+        bool prefetch);
+    void onImageDecoded(
+        const std::string& key,
+        uint64_t id,
+        size_t memorySize,
+        bool reduced,
+        std::chrono::milliseconds decodeTime);
+    void onEntryGrown(const std::string& key, uint64_t id, size_t bytes);
+    void recordLookup(const CacheEntry& entry);
+    void pin(Shard& shard, CacheEntry& entry);
+    void unpin(Shard& shard, const std::string& key, CacheEntry& entry);
+    void setPinned(const std::string& path, bool pinned);
+    void evictUntilFits();
+    bool evictOneAnimation(const std::string& displayedPath);
+    bool evictOne(Shard& shard);
+    void evict(Shard& shard, std::list<std::string>::iterator clockIterator);
 };
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "DecodeQueue.hpp"
+
+namespace
+{
+    thread_local bool isDecodeWorker = false;
+}
+
+DecodeQueue::DecodeQueue(const size_t threadCount)
+{
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        _threads.emplace_back([this] { workerLoop(); });
+    }
+}
+
+DecodeQueue::~DecodeQueue()
+{
+    cancelAll();
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+
+    // Only jobs that already started are waited for, pending ones were abandoned above
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+void DecodeQueue::push(const std::string& key, const DecodePriority priority, Job job, Job onCancel)
+{
+    QueuedJob replaced;
+    {
+        std::lock_guard lock(_mutex);
+        replaced = take(key);
+
+        const QueuePosition position = { priority, _sequence-- };
+        _queue.emplace(position, QueuedJob{ .key = key, .job = std::move(job), .onCancel = std::move(onCancel) });
+        _positions.emplace(key, position);
+    }
+    _condition.notify_one();
+
+    if (replaced.onCancel)
+    {
+        replaced.onCancel();
+    }
+}
+
+bool DecodeQueue::promote(const std::string& key, const DecodePriority priority)
+{
+    return reposition(key, priority, true);
+}
+
+bool DecodeQueue::setPriority(const std::string& key, const DecodePriority priority)
+{
+    return reposition(key, priority, false);
+}
+
+bool DecodeQueue::cancel(const std::string& key)
+{
+    QueuedJob cancelled;
+    {
+        std::lock_guard lock(_mutex);
+        cancelled = take(key);
+    }
+
+    // Jobs taken out of the queue always carry their key, a job queued without a cancel callback still counts
+    if (cancelled.key.empty())
+    {
+        return false;
+    }
+    if (cancelled.onCancel)
+    {
+        cancelled.onCancel();
+    }
+    return true;
+}
+
+std::vector<std::string> DecodeQueue::cancelAllExcept(const std::unordered_set<std::string>& keep)
+{
+    std::vector<QueuedJob> cancelled;
+    {
+        std::lock_guard lock(_mutex);
+        for (auto it = _queue.begin(); it != _queue.end();)
+        {
+            if (keep.contains(it->second.key))
+            {
+                ++it;
+                continue;
+            }
+            _positions.erase(it->second.key);
+            cancelled.push_back(std::move(it->second));
+            it = _queue.erase(it);
+        }
+    }
+
+    std::vector<std::string> keys;
+    keys.reserve(cancelled.size());
+    for (auto& job : cancelled)
+    {
+        if (job.onCancel)
+        {
+            job.onCancel();
+        }
+        keys.push_back(std::move(job.key));
+    }
+    return keys;
+}
+
+void DecodeQueue::cancelAll()
+{
+    cancelAllExcept({});
+}
+
+bool DecodeQueue::isWorkerThread()
+{
+    return isDecodeWorker;
+}
+
+void DecodeQueue::workerLoop()
+{
+    isDecodeWorker = true;
+    for (;;)
+    {
+        QueuedJob current;
+        {
+            std::unique_lock lock(_mutex);
+            _condition.wait(lock, [this] { return _stopping || !_queue.empty(); });
+            if (_stopping)
+            {
+                return;
+            }
+
+            auto node = _queue.extract(_queue.begin());
+            _positions.erase(node.mapped().key);
+            current = std::move(node.mapped());
+        }
+        current.job();
+    }
+}
+
+bool DecodeQueue::reposition(const std::string& key, const DecodePriority priority, const bool onlyRaise)
+{
+    std::lock_guard lock(_mutex);
+    const auto it = _positions.find(key);
+    if (it == _positions.end())
+    {
+        return false;
+    }
+
+    if (it->second.first == priority || (onlyRaise && it->second.first < priority))
+    {
+        return true;
+    }
+
+    auto node = _queue.extract(it->second);
+    node.key() = { priority, it->second.second };
+    it->second = node.key();
+    _queue.insert(std::move(node));
+    return true;
+}
+
+DecodeQueue::QueuedJob DecodeQueue::take(const std::string& key)
+{
+    const auto it = _positions.find(key);
+    if (it == _positions.end())
+    {
+        return {};
+    }
+
+    auto node = _queue.extract(it->second);
+    _positions.erase(it);
+    return std::move(node.mapped());
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum class DecodePriority
+{
+    Current,
+    Next,
+    Previous,
+    Far
+};
+
+class DecodeQueue
+{
+public:
+    using Job = std::function<void()>;
+
+    explicit DecodeQueue(size_t threadCount);
+    DecodeQueue(const DecodeQueue&) = delete;
+    ~DecodeQueue();
+
+    void push(const std::string& key, DecodePriority priority, Job job, Job onCancel);
+    bool promote(const std::string& key, DecodePriority priority);
+    bool setPriority(const std::string& key, DecodePriority priority);
+    bool cancel(const std::string& key);
+    std::vector<std::string> cancelAllExcept(const std::unordered_set<std::string>& keep);
+    void cancelAll();
+
+    // Whether the calling thread is running a job of any DecodeQueue
+    static bool isWorkerThread();
+
+private:
+    struct QueuedJob
+    {
+        std::string key;
+        Job job;
+        Job onCancel;
+    };
+
+    // Ordered by priority first, then newest request first
+    using QueuePosition = std::pair<DecodePriority, uint64_t>;
+
+    std::map<QueuePosition, QueuedJob> _queue;
+    std::unordered_map<std::string, QueuePosition> _positions;
+    uint64_t _sequence = std::numeric_limits<uint64_t>::max();
+    bool _stopping = false;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::vector<std::thread> _threads;
+
+    void workerLoop();
+    bool reposition(const std::string& key, DecodePriority priority, bool onlyRaise);
+    QueuedJob take(const std::string& key);
+};
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "DirectoryIndex.hpp"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <ien/fs_utils.hpp>
+
+#include <filesystem>
+#include <format>
+#include <ranges>
+
+#include "Utils.hpp"
+
+constexpr quint64 INDEX_MAGIC = 0x3158444954514749; // "IGQTIDX1"
+constexpr quint32 INDEX_VERSION = 1;
+// Stored in place of a kind for files that were never classified
+constexpr qint8 UNKNOWN_KIND = -1;
+
+namespace
+{
+    std::string getIndexFilePath(const std::string& directory)
+    {
+        // FNV-1a, so file names stay stable across runs and builds
+        uint64_t hash = 0xcbf29ce484222325;
+        for (const char c : directory)
+        {
+            hash ^= static_cast<uint8_t>(c);
+            hash *= 0x100000001b3;
+        }
+
+        return getCacheFilePath(std::format("index/{:016x}.idx", hash));
+    }
+
+    int64_t getDirectoryMtime(const std::string& directory)
+    {
+        std::error_code ec;
+        const auto mtime = std::filesystem::last_write_time(directory, ec);
+        return ec ? 0 : static_cast<int64_t>(mtime.time_since_epoch().count());
+    }
+}
+
+DirectoryIndex::~DirectoryIndex()
+{
+    save();
+}
+
+std::optional<std::vector<FileEntry>> DirectoryIndex::open(const std::string& directory)
+{
+    save();
+    _directory = directory;
+    _directoryMtime = getDirectoryMtime(directory);
+    _entries.clear();
+    _current = false;
+    _dirty = false;
+
+    QFile file(QString::fromStdString(getIndexFilePath(directory)));
+    if (_directoryMtime == 0 || !file.open(QIODevice::ReadOnly))
+    {
+        return std::nullopt;
+    }
+
+    QDataStream stream(&file);
+    quint64 magic = 0;
+    quint32 version = 0;
+    QByteArray storedDirectory;
+    qint64 storedMtime = 0;
+    quint32 count = 0;
+    stream >> magic >> version >> storedDirectory >> storedMtime >> count;
+    // The directory is stored too, two of them sharing a hash must not share a listing
+    if (stream.status() != QDataStream::Ok || magic != INDEX_MAGIC || version != INDEX_VERSION ||
+        storedDirectory.toStdString() != directory)
+    {
+        return std::nullopt;
+    }
+
+    const std::filesystem::path directoryPath(directory);
+    _entries.reserve(count);
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+    {
+        QByteArray name;
+        qint64 mtime = 0;
+        quint64 size = 0;
+        qint8 kind = UNKNOWN_KIND;
+        qint32 width = 0;
+        qint32 height = 0;
+        stream >> name >> mtime >> size >> kind >> width >> height;
+
+        FileEntry entry{
+            .path = (directoryPath / name.toStdString()).string(),
+            .mtime = static_cast<time_t>(mtime),
+            .size = size,
+            .kind = kind == UNKNOWN_KIND ? std::nullopt : std::optional(static_cast<MediaKind>(kind)),
+            .dimensions = QSize(width, height)
+        };
+        auto key = entry.path;
+        _entries.insert_or_assign(std::move(key), std::move(entry));
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        qDebug() << "Discarding unreadable directory index for" << QString::fromStdString(directory);
+        _entries.clear();
+        return std::nullopt;
+    }
+
+    // Adding, removing or renaming a file bumps the directory mtime. Files rewritten in place don't, the caller
+    // catches those by scanning in the background and passing the result to update().
+    if (storedMtime != _directoryMtime)
+    {
+        return std::nullopt;
+    }
+
+    _current = true;
+    std::vector<FileEntry> result;
+    result.reserve(_entries.size());
+    for (const auto& entry : _entries | std::views::values)
+    {
+        result.push_back(entry);
+    }
+    return result;
+}
+
+void DirectoryIndex::restoreProbes(std::vector<FileEntry>& entries) const
+{
+    for (auto& entry : entries)
+    {
+        const auto it = _entries.find(entry.path);
+        if (it != _entries.end() && it->second.mtime == entry.mtime && it->second.size == entry.size)
+        {
+            entry.kind = it->second.kind;
+            entry.dimensions = it->second.dimensions;
+        }
+    }
+}
+
+void DirectoryIndex::update(const std::vector<FileEntry>& entries)
+{
+    _entries.clear();
+    _entries.reserve(entries.size());
+    for (const auto& entry : entries)
+    {
+        _entries.insert_or_assign(entry.path, entry);
+    }
+    _current = true;
+    _dirty = true;
+    save();
+}
+
+void DirectoryIndex::patch(const std::vector<FileEntry>& changed, const std::vector<std::string>& removed)
+{
+    for (auto entry : changed)
+    {
+        if (const auto it = _entries.find(entry.path);
+            it != _entries.end() && it->second.mtime == entry.mtime && it->second.size == entry.size)
+        {
+            entry.kind = it->second.kind;
+            entry.dimensions = it->second.dimensions;
+        }
+        _entries.insert_or_assign(entry.path, std::move(entry));
+    }
+    for (const auto& path : removed)
+    {
+        _entries.erase(path);
+    }
+    // _directoryMtime is left alone: notifications for later changes may still be on their way, so only a full
+    // scan may vouch for the directory as it is now. Until then, reopening it scans it again.
+    _dirty = true;
+}
+
+void DirectoryIndex::recordProbe(const std::string& path, const MediaKind kind, const QSize dimensions)
+{
+    const auto it = _entries.find(path);
+    if (it == _entries.end())
+    {
+        return;
+    }
+
+    auto& entry = it->second;
+    if (entry.kind != kind || (dimensions.isValid() && entry.dimensions != dimensions))
+    {
+        entry.kind = kind;
+        if (dimensions.isValid())
+        {
+            entry.dimensions = dimensions;
+        }
+        _dirty = true;
+    }
+}
+
+void DirectoryIndex::save()
+{
+    if (!_dirty || !_current)
+    {
+        return;
+    }
+    _dirty = false;
+
+    const auto path = QString::fromStdString(getIndexFilePath(_directory));
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // Written to a temporary file and renamed, so a crash can't leave a truncated index behind
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qDebug() << "Unable to write directory index" << path;
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream << INDEX_MAGIC << INDEX_VERSION << QByteArray::fromStdString(_directory)
+           << static_cast<qint64>(_directoryMtime) << static_cast<quint32>(_entries.size());
+    for (const auto& entry : _entries | std::views::values)
+    {
+        const auto name = std::filesystem::path(entry.path).filename().string();
+        stream << QByteArray::fromStdString(name) << static_cast<qint64>(entry.mtime)
+               << static_cast<quint64>(entry.size) << (entry.kind ? static_cast<qint8>(*entry.kind) : UNKNOWN_KIND)
+               << static_cast<qint32>(entry.dimensions.width()) << static_cast<qint32>(entry.dimensions.height());
+    }
+
+    if (!file.commit())
+    {
+        qDebug() << "Unable to write directory index" << path;
+    }
+}
\ No newline at end of file
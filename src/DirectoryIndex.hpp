@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QSize>
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DirectoryScanner.hpp"
+
+// Listing and probed metadata of the open directory, kept on disk so that reopening it doesn't touch every file
+class DirectoryIndex
+{
+public:
+    DirectoryIndex() = default;
+    DirectoryIndex(const DirectoryIndex&) = delete;
+    ~DirectoryIndex();
+
+    // Switches to a directory, returning its stored listing if the directory hasn't changed since it was written.
+    // Files rewritten in place don't change the directory, so the listing still needs revalidating by a scan.
+    std::optional<std::vector<FileEntry>> open(const std::string& directory);
+    // Copies what is known about files whose mtime and size are unchanged into freshly scanned entries
+    void restoreProbes(std::vector<FileEntry>& entries) const;
+    // Replaces the listing with a completed scan of the open directory and writes it out
+    void update(const std::vector<FileEntry>& entries);
+    // Applies changes reported while the directory is open, without scanning it again
+    void patch(const std::vector<FileEntry>& changed, const std::vector<std::string>& removed);
+    void recordProbe(const std::string& path, MediaKind kind, QSize dimensions);
+    void save();
+
+private:
+    std::string _directory;
+    // Taken when the directory is opened, so changes made while it is being scanned invalidate the index
+    int64_t _directoryMtime = 0;
+    std::unordered_map<std::string, FileEntry> _entries;
+    // Whether _entries match the directory as of _directoryMtime, a stale listing is never written out
+    bool _current = false;
+    bool _dirty = false;
+};
\ No newline at end of file
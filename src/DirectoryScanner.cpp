@@ -0,0 +1,257 @@
+#include "DirectoryScanner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iterator>
+#include <optional>
+#include <span>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Utils.hpp"
+
+namespace
+{
+    // Entries are handed over in batches, so the first ones are shown while the rest are still being read
+    constexpr size_t BATCH_SIZE = 1024;
+
+#ifdef __linux__
+    constexpr size_t DIRENT_BUFFER_SIZE = 256 * 1024;
+
+    struct LinuxDirent64
+    {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    class DirectoryDescriptor
+    {
+    public:
+        explicit DirectoryDescriptor(const std::string& path)
+            : _fd(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC))
+        {
+        }
+        DirectoryDescriptor(const DirectoryDescriptor&) = delete;
+        ~DirectoryDescriptor()
+        {
+            if (_fd >= 0)
+            {
+                close(_fd);
+            }
+        }
+
+        int get() const { return _fd; }
+
+    private:
+        int _fd;
+    };
+
+    // Stats the batch across threads, statx relative to the directory skips resolving the full path again
+    std::vector<FileEntry> statBatch(
+        const int directoryFd,
+        const std::filesystem::path& directory,
+        const std::span<const std::string> names)
+    {
+        std::vector<std::optional<FileEntry>> results(names.size());
+
+#pragma omp parallel for schedule(dynamic, 16)
+        for (long i = 0; i < static_cast<long>(names.size()); ++i)
+        {
+            struct statx info{};
+            // Cached attributes are good enough to list and sort by, and save a round trip per file on NFS
+            if (statx(directoryFd, names[i].c_str(), AT_STATX_DONT_SYNC, STATX_TYPE | STATX_MTIME | STATX_SIZE, &info) != 0 ||
+                !S_ISREG(info.stx_mode))
+            {
+                continue;
+            }
+            results[i] = FileEntry{
+                .path = (directory / names[i]).string(),
+                .mtime = static_cast<time_t>(info.stx_mtime.tv_sec),
+                .size = info.stx_size
+            };
+        }
+
+        std::vector<FileEntry> batch;
+        batch.reserve(names.size());
+        for (auto& result : results)
+        {
+            if (result)
+            {
+                batch.push_back(std::move(*result));
+            }
+        }
+        return batch;
+    }
+#endif
+}
+
+void scanDirectory(const std::string& directory, const ScanBatchCallback& onBatch, const std::stop_token stopToken)
+{
+    const std::filesystem::path directoryPath(directory);
+
+#ifdef __linux__
+    const DirectoryDescriptor fd(directory);
+    if (fd.get() < 0)
+    {
+        return;
+    }
+
+    std::vector<char> buffer(DIRENT_BUFFER_SIZE);
+    std::vector<std::string> names;
+    for (;;)
+    {
+        const auto bytesRead = syscall(SYS_getdents64, fd.get(), buffer.data(), buffer.size());
+        if (bytesRead <= 0 || stopToken.stop_requested())
+        {
+            break;
+        }
+
+        for (long offset = 0; offset < bytesRead;)
+        {
+            const auto* entry = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+            offset += entry->d_reclen;
+
+            // Symlinks and filesystems that don't report types are sorted out by statx
+            if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+            {
+                continue;
+            }
+            std::string name(entry->d_name);
+            if (hasMediaExtension(name))
+            {
+                names.push_back(std::move(name));
+            }
+        }
+
+        size_t statted = 0;
+        for (; names.size() - statted >= BATCH_SIZE && !stopToken.stop_requested(); statted += BATCH_SIZE)
+        {
+            if (auto batch = statBatch(fd.get(), directoryPath, std::span(names).subspan(statted, BATCH_SIZE));
+                !batch.empty())
+            {
+                onBatch(std::move(batch));
+            }
+        }
+        names.erase(names.begin(), names.begin() + static_cast<ptrdiff_t>(statted));
+    }
+
+    if (!names.empty() && !stopToken.stop_requested())
+    {
+        if (auto batch = statBatch(fd.get(), directoryPath, names); !batch.empty())
+        {
+            onBatch(std::move(batch));
+        }
+    }
+#else
+    std::vector<FileEntry> batch;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(directoryPath, error))
+    {
+        if (stopToken.stop_requested())
+        {
+            return;
+        }
+
+        // The directory listing already carries these attributes on Windows, so the file isn't opened again
+        auto path = entry.path().string();
+        if (!hasMediaExtension(path) || !entry.is_regular_file(error))
+        {
+            continue;
+        }
+        const auto mtime = entry.last_write_time(error);
+        const auto size = entry.file_size(error);
+        if (error)
+        {
+            continue;
+        }
+
+        batch.push_back(FileEntry{
+            .path = std::move(path),
+            .mtime = std::chrono::system_clock::to_time_t(std::chrono::clock_cast<std::chrono::system_clock>(mtime)),
+            .size = size
+        });
+        if (batch.size() >= BATCH_SIZE)
+        {
+            onBatch(std::move(batch));
+            batch.clear();
+        }
+    }
+
+    if (!batch.empty())
+    {
+        onBatch(std::move(batch));
+    }
+#endif
+}
+
+std::vector<FileEntry> scanDirectory(const std::string& directory)
+{
+    std::vector<FileEntry> result;
+    scanDirectory(directory, [&](std::vector<FileEntry>&& batch) {
+        std::ranges::move(batch, std::back_inserter(result));
+    });
+    return result;
+}
+
+std::optional<FileEntry> statFile(const std::string& path)
+{
+#ifdef __linux__
+    struct statx info{};
+    if (statx(AT_FDCWD, path.c_str(), AT_STATX_SYNC_AS_STAT, STATX_TYPE | STATX_MTIME | STATX_SIZE, &info) != 0 ||
+        !S_ISREG(info.stx_mode))
+    {
+        return std::nullopt;
+    }
+    return FileEntry{ .path = path, .mtime = static_cast<time_t>(info.stx_mtime.tv_sec), .size = info.stx_size };
+#else
+    std::error_code error;
+    const std::filesystem::directory_entry entry(path, error);
+    if (error || !entry.is_regular_file(error))
+    {
+        return std::nullopt;
+    }
+    const auto mtime = entry.last_write_time(error);
+    const auto size = entry.file_size(error);
+    if (error)
+    {
+        return std::nullopt;
+    }
+    return FileEntry{
+        .path = path,
+        .mtime = std::chrono::system_clock::to_time_t(std::chrono::clock_cast<std::chrono::system_clock>(mtime)),
+        .size = size
+    };
+#endif
+}
+
+void DirectoryScanner::start(const std::string& directory, ScanBatchCallback onBatch, std::function<void()> onFinished)
+{
+    stop();
+    _thread = std::jthread([directory, onBatch = std::move(onBatch), onFinished = std::move(onFinished)](
+                               const std::stop_token stopToken) {
+        scanDirectory(directory, onBatch, stopToken);
+        if (!stopToken.stop_requested())
+        {
+            onFinished();
+        }
+    });
+}
+
+void DirectoryScanner::stop()
+{
+    if (_thread.joinable())
+    {
+        _thread.request_stop();
+        _thread.join();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QSize>
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Utils.hpp"
+
+struct FileEntry
+{
+    std::string path;
+    time_t mtime;
+    uint64_t size = 0;
+    // Filled in once the file has been classified or decoded, and remembered by DirectoryIndex
+    std::optional<MediaKind> kind;
+    QSize dimensions;
+
+    bool operator==(const FileEntry& rhs) const { return path == rhs.path && mtime && rhs.mtime; }
+};
+
+// Receives entries in directory order, several times per scan
+using ScanBatchCallback = std::function<void(std::vector<FileEntry>&&)>;
+
+// Lists the media files directly inside a directory, reading the metadata of each file with a single call
+void scanDirectory(const std::string& directory, const ScanBatchCallback& onBatch, std::stop_token stopToken = {});
+std::vector<FileEntry> scanDirectory(const std::string& directory);
+// Reads the metadata of one file the way scans do, nullopt unless it is a regular file
+std::optional<FileEntry> statFile(const std::string& path);
+
+// Runs scanDirectory on a background thread, the callbacks are invoked from that thread
+class DirectoryScanner
+{
+public:
+    // Stops the scan in progress, if any, before starting the new one
+    void start(const std::string& directory, ScanBatchCallback onBatch, std::function<void()> onFinished);
+    // Returns once no callback is running anymore, onFinished is not invoked for a stopped scan
+    void stop();
+
+private:
+    std::jthread _thread;
+};
\ No newline at end of file
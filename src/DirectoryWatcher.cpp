@@ -0,0 +1,177 @@
+#include "DirectoryWatcher.hpp"
+
+#include <QDebug>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+
+#include <array>
+#include <filesystem>
+#include <ranges>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "DirectoryScanner.hpp"
+
+// Tools writing many files at once produce bursts of events, which are applied together
+constexpr int FLUSH_DELAY_MS = 200;
+
+#ifdef __linux__
+// Rewrites, renames in and out, deletions, and mtimes being restored after a file was replaced
+constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ATTRIB | IN_ONLYDIR;
+#endif
+
+DirectoryWatcher::DirectoryWatcher(QObject* parent)
+    : QObject(parent)
+{
+    _flushTimer = new QTimer(this);
+    _flushTimer->setSingleShot(true);
+    _flushTimer->setInterval(FLUSH_DELAY_MS);
+    connect(_flushTimer, &QTimer::timeout, this, [this] { flush(); });
+
+#ifdef __linux__
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotifyFd < 0)
+    {
+        qDebug() << "inotify unavailable, directory changes won't be picked up";
+        return;
+    }
+    _notifier = new QSocketNotifier(_inotifyFd, QSocketNotifier::Read, this);
+    connect(_notifier, &QSocketNotifier::activated, this, [this] { readEvents(); });
+#else
+    _watcher = new QFileSystemWatcher(this);
+    connect(_watcher, &QFileSystemWatcher::directoryChanged, this, [this] { takeSnapshot(true); });
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#ifdef __linux__
+    // The notifier has to stop listening before its descriptor is closed
+    delete _notifier;
+    if (_inotifyFd >= 0)
+    {
+        close(_inotifyFd);
+    }
+#endif
+}
+
+void DirectoryWatcher::watch(const std::string& directory)
+{
+    _changedPaths.clear();
+    _flushTimer->stop();
+    _directory = directory;
+
+#ifdef __linux__
+    if (_inotifyFd < 0)
+    {
+        return;
+    }
+    if (_watchDescriptor >= 0)
+    {
+        inotify_rm_watch(_inotifyFd, _watchDescriptor);
+        _watchDescriptor = -1;
+    }
+    if (!directory.empty())
+    {
+        _watchDescriptor = inotify_add_watch(_inotifyFd, directory.c_str(), WATCH_MASK);
+    }
+#else
+    if (const auto watched = _watcher->directories(); !watched.isEmpty())
+    {
+        _watcher->removePaths(watched);
+    }
+    _snapshot.clear();
+    if (!directory.empty())
+    {
+        _watcher->addPath(QString::fromStdString(directory));
+        takeSnapshot(false);
+    }
+#endif
+}
+
+#ifdef __linux__
+void DirectoryWatcher::readEvents()
+{
+    alignas(inotify_event) std::array<char, 64 * 1024> buffer{};
+    for (;;)
+    {
+        const auto length = read(_inotifyFd, buffer.data(), buffer.size());
+        if (length <= 0)
+        {
+            break;
+        }
+
+        for (long offset = 0; offset < length;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+            offset += static_cast<long>(sizeof(inotify_event) + event->len);
+
+            if ((event->mask & IN_Q_OVERFLOW) != 0)
+            {
+                _changedPaths.clear();
+                _flushTimer->stop();
+                emit overflowed();
+                continue;
+            }
+            // Events still queued for a directory that is no longer watched carry its old descriptor
+            if (event->wd != _watchDescriptor || event->len == 0)
+            {
+                continue;
+            }
+            _changedPaths.insert((std::filesystem::path(_directory) / event->name).string());
+        }
+    }
+
+    if (!_changedPaths.empty() && !_flushTimer->isActive())
+    {
+        _flushTimer->start();
+    }
+}
+#else
+void DirectoryWatcher::takeSnapshot(const bool reportChanges)
+{
+    decltype(_snapshot) snapshot;
+    for (const auto& entry : scanDirectory(_directory))
+    {
+        snapshot.emplace(entry.path, std::pair(entry.mtime, entry.size));
+    }
+
+    if (reportChanges)
+    {
+        for (const auto& [path, state] : snapshot)
+        {
+            if (const auto it = _snapshot.find(path); it == _snapshot.end() || it->second != state)
+            {
+                _changedPaths.insert(path);
+            }
+        }
+        for (const auto& path : _snapshot | std::views::keys)
+        {
+            if (!snapshot.contains(path))
+            {
+                _changedPaths.insert(path);
+            }
+        }
+        if (!_changedPaths.empty() && !_flushTimer->isActive())
+        {
+            _flushTimer->start();
+        }
+    }
+    _snapshot = std::move(snapshot);
+}
+#endif
+
+void DirectoryWatcher::flush()
+{
+    if (_changedPaths.empty())
+    {
+        return;
+    }
+
+    std::vector<std::string> paths(_changedPaths.begin(), _changedPaths.end());
+    _changedPaths.clear();
+    emit filesChanged(paths);
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class QFileSystemWatcher;
+class QSocketNotifier;
+
+// Reports files of one directory that were added, rewritten or removed, gathered over a short delay
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject* parent = nullptr);
+    ~DirectoryWatcher() override;
+
+    // Replaces the watched directory, an empty path stops watching
+    void watch(const std::string& directory);
+
+signals:
+    // Whether each path still exists is left for the receiver to find out
+    void filesChanged(const std::vector<std::string>& paths);
+    // Some changes were lost, the whole directory has to be read again
+    void overflowed();
+
+private:
+    std::string _directory;
+    std::unordered_set<std::string> _changedPaths;
+    QTimer* _flushTimer = nullptr;
+#ifdef __linux__
+    int _inotifyFd = -1;
+    int _watchDescriptor = -1;
+    QSocketNotifier* _notifier = nullptr;
+
+    void readEvents();
+#else
+    QFileSystemWatcher* _watcher = nullptr;
+    // Last seen mtime and size by path, notifications only say that something in the directory changed
+    std::unordered_map<std::string, std::pair<time_t, uint64_t>> _snapshot;
+
+    void takeSnapshot(bool reportChanges);
+#endif
+
+    void flush();
+};
\ No newline at end of file
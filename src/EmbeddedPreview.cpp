@@ -0,0 +1,217 @@
+#include "EmbeddedPreview.hpp"
+
+#include <QFile>
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+#include <ien/str_utils.hpp>
+
+namespace
+{
+    // Headers past this point are not worth reading, decoding the image would be cheaper
+    constexpr qint64 MAX_HEADER_BYTES = 256 * 1024;
+    constexpr double MAX_ASPECT_DIFFERENCE = 0.02;
+
+    constexpr uint8_t MARKER_SOS = 0xDA;
+    constexpr uint8_t MARKER_APP0 = 0xE0;
+    constexpr uint8_t MARKER_APP1 = 0xE1;
+
+    constexpr uint16_t TAG_JPEG_OFFSET = 0x0201;
+    constexpr uint16_t TAG_JPEG_LENGTH = 0x0202;
+    constexpr uint16_t TYPE_SHORT = 3;
+
+    bool isStartOfFrame(const uint8_t marker)
+    {
+        // C4, C8 and CC share the range but are tables and a reserved marker
+        return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+    }
+
+    class TiffReader
+    {
+    public:
+        explicit TiffReader(const std::span<const uint8_t> data)
+            : _data(data)
+            , _bigEndian(data.size() >= 2 && data[0] == 'M')
+        {
+        }
+
+        std::optional<uint16_t> u16(const size_t offset) const
+        {
+            if (offset + 2 > _data.size())
+            {
+                return std::nullopt;
+            }
+            return _bigEndian ? static_cast<uint16_t>((_data[offset] << 8) | _data[offset + 1])
+                              : static_cast<uint16_t>(_data[offset] | (_data[offset + 1] << 8));
+        }
+
+        std::optional<uint32_t> u32(const size_t offset) const
+        {
+            const auto first = u16(offset);
+            const auto second = u16(offset + 2);
+            if (!first || !second)
+            {
+                return std::nullopt;
+            }
+            return _bigEndian ? (static_cast<uint32_t>(*first) << 16) | *second
+                              : (static_cast<uint32_t>(*second) << 16) | *first;
+        }
+
+    private:
+        std::span<const uint8_t> _data;
+        bool _bigEndian;
+    };
+
+    std::optional<QByteArray> exifThumbnail(const QByteArray& payload)
+    {
+        constexpr std::string_view EXIF_HEADER("Exif\0\0", 6);
+        if (!payload.startsWith(QByteArray(EXIF_HEADER.data(), EXIF_HEADER.size())))
+        {
+            return std::nullopt;
+        }
+
+        const auto tiffBytes = payload.mid(EXIF_HEADER.size());
+        const TiffReader tiff({ reinterpret_cast<const uint8_t*>(tiffBytes.constData()), static_cast<size_t>(tiffBytes.size()) });
+
+        // IFD0 describes the image, the IFD linked after it describes the thumbnail
+        const auto ifd0 = tiff.u32(4);
+        const auto ifd0Count = ifd0 ? tiff.u16(*ifd0) : std::nullopt;
+        const auto ifd1 = ifd0Count ? tiff.u32(*ifd0 + 2 + (*ifd0Count * 12)) : std::nullopt;
+        const auto ifd1Count = ifd1 && *ifd1 != 0 ? tiff.u16(*ifd1) : std::nullopt;
+        if (!ifd1Count)
+        {
+            return std::nullopt;
+        }
+
+        std::optional<uint32_t> offset;
+        std::optional<uint32_t> length;
+        for (size_t i = 0; i < *ifd1Count; ++i)
+        {
+            const size_t entry = *ifd1 + 2 + (i * 12);
+            const auto tag = tiff.u16(entry);
+            const auto type = tiff.u16(entry + 2);
+            if (!tag || !type)
+            {
+                return std::nullopt;
+            }
+
+            std::optional<uint32_t> value = tiff.u32(entry + 8);
+            if (*type == TYPE_SHORT)
+            {
+                value = tiff.u16(entry + 8);
+            }
+            if (*tag == TAG_JPEG_OFFSET)
+            {
+                offset = value;
+            }
+            else if (*tag == TAG_JPEG_LENGTH)
+            {
+                length = value;
+            }
+        }
+
+        if (!offset || !length || *length == 0 || static_cast<qsizetype>(*offset) + *length > tiffBytes.size())
+        {
+            return std::nullopt;
+        }
+        return tiffBytes.mid(*offset, *length);
+    }
+
+    std::optional<QByteArray> jfifThumbnail(const QByteArray& payload)
+    {
+        // JFIF extension segment holding a JPEG-coded thumbnail (extension code 0x10)
+        constexpr std::string_view JFXX_HEADER("JFXX\0", 5);
+        if (!payload.startsWith(QByteArray(JFXX_HEADER.data(), JFXX_HEADER.size())) || payload.size() <= 6 ||
+            static_cast<uint8_t>(payload[5]) != 0x10)
+        {
+            return std::nullopt;
+        }
+        return payload.mid(6);
+    }
+}
+
+std::optional<QImage> readEmbeddedPreview(const std::string& path, const int minimumSize)
+{
+    const auto extension = ien::str_tolower(std::filesystem::path(path).extension().string());
+    if (extension != ".jpg" && extension != ".jpeg")
+    {
+        return std::nullopt;
+    }
+
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return std::nullopt;
+    }
+
+    const QByteArray start = file.read(2);
+    if (start.size() != 2 || static_cast<uint8_t>(start[0]) != 0xFF || static_cast<uint8_t>(start[1]) != 0xD8)
+    {
+        return std::nullopt;
+    }
+
+    std::optional<QByteArray> thumbnail;
+    QSize imageSize;
+    while (file.pos() < MAX_HEADER_BYTES)
+    {
+        const QByteArray marker = file.read(4);
+        if (marker.size() != 4 || static_cast<uint8_t>(marker[0]) != 0xFF)
+        {
+            break;
+        }
+
+        const auto type = static_cast<uint8_t>(marker[1]);
+        const qint64 length = (static_cast<uint8_t>(marker[2]) << 8) | static_cast<uint8_t>(marker[3]);
+        if (length < 2 || type == MARKER_SOS)
+        {
+            break;
+        }
+
+        if (isStartOfFrame(type))
+        {
+            const QByteArray frame = file.read(5);
+            if (frame.size() == 5)
+            {
+                imageSize = QSize(
+                    (static_cast<uint8_t>(frame[3]) << 8) | static_cast<uint8_t>(frame[4]),
+                    (static_cast<uint8_t>(frame[1]) << 8) | static_cast<uint8_t>(frame[2]));
+            }
+            break;
+        }
+
+        if (!thumbnail && (type == MARKER_APP0 || type == MARKER_APP1))
+        {
+            const QByteArray payload = file.read(length - 2);
+            thumbnail = type == MARKER_APP1 ? exifThumbnail(payload) : jfifThumbnail(payload);
+        }
+        else if (!file.skip(length - 2))
+        {
+            break;
+        }
+    }
+
+    if (!thumbnail)
+    {
+        return std::nullopt;
+    }
+
+    QImage preview = QImage::fromData(*thumbnail, "JPEG");
+    if (preview.isNull() || std::max(preview.width(), preview.height()) < minimumSize)
+    {
+        return std::nullopt;
+    }
+
+    if (imageSize.isValid() && !imageSize.isEmpty())
+    {
+        const double imageAspect = static_cast<double>(imageSize.width()) / imageSize.height();
+        const double previewAspect = static_cast<double>(preview.width()) / preview.height();
+        if (std::abs(imageAspect - previewAspect) / imageAspect > MAX_ASPECT_DIFFERENCE)
+        {
+            return std::nullopt;
+        }
+    }
+    return preview;
+}
\ No newline at end of file
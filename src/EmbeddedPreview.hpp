@@ -0,0 +1,11 @@
+#pragma once
+
+#include <QImage>
+
+#include <optional>
+#include <string>
+
+// Reads the thumbnail a JPEG carries in its EXIF (IFD1) or JFIF extension segment, without decoding the image itself.
+// Only the header segments are read, and previews smaller than minimumSize on their longer side or with a different
+// aspect ratio than the image (letterboxed camera thumbnails) are rejected.
+std::optional<QImage> readEmbeddedPreview(const std::string& path, int minimumSize);
\ No newline at end of file
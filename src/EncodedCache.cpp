@@ -0,0 +1,115 @@
+#include "EncodedCache.hpp"
+
+#include <QFile>
+
+#include <algorithm>
+
+// Used until enough files were read to know their typical size
+constexpr size_t DEFAULT_AFFORDABLE_ENTRIES = 32;
+constexpr size_t MAX_AFFORDABLE_ENTRIES = 256;
+
+EncodedCache::EncodedCache(const size_t maxBytes)
+    : _maxSize(maxBytes)
+{
+}
+
+std::shared_ptr<const QByteArray> EncodedCache::load(const std::string& path)
+{
+    if (auto bytes = find(path))
+    {
+        return bytes;
+    }
+
+    // Read without holding the lock, NAS reads can take a while
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return nullptr;
+    }
+    auto bytes = std::make_shared<const QByteArray>(file.readAll());
+    const auto size = static_cast<size_t>(bytes->size());
+
+    std::lock_guard lock(_mutex);
+    _loadedBytes += size;
+    ++_loadCount;
+    if (size > _maxSize || _entries.contains(path))
+    {
+        return bytes;
+    }
+
+    evictUntilFits(size);
+    _lru.push_front(path);
+    _entries.emplace(path, Entry{ .bytes = bytes, .lruIterator = _lru.begin() });
+    _currentSize += size;
+    return bytes;
+}
+
+bool EncodedCache::contains(const std::string& path)
+{
+    std::lock_guard lock(_mutex);
+    return _entries.contains(path);
+}
+
+size_t EncodedCache::affordableEntries()
+{
+    std::lock_guard lock(_mutex);
+    if (_loadCount < 4 || _loadedBytes == 0)
+    {
+        return DEFAULT_AFFORDABLE_ENTRIES;
+    }
+    const size_t averageSize = _loadedBytes / _loadCount;
+    return std::min(_maxSize / averageSize, MAX_AFFORDABLE_ENTRIES);
+}
+
+void EncodedCache::setMaxSize(const size_t bytes)
+{
+    std::lock_guard lock(_mutex);
+    _maxSize = bytes;
+    evictUntilFits(0);
+}
+
+void EncodedCache::remove(const std::string& path)
+{
+    std::lock_guard lock(_mutex);
+    const auto it = _entries.find(path);
+    if (it == _entries.end())
+    {
+        return;
+    }
+
+    _currentSize -= static_cast<size_t>(it->second.bytes->size());
+    _lru.erase(it->second.lruIterator);
+    _entries.erase(it);
+}
+
+void EncodedCache::clear()
+{
+    std::lock_guard lock(_mutex);
+    _entries.clear();
+    _lru.clear();
+    _currentSize = 0;
+}
+
+std::shared_ptr<const QByteArray> EncodedCache::find(const std::string& path)
+{
+    std::lock_guard lock(_mutex);
+    const auto it = _entries.find(path);
+    if (it == _entries.end())
+    {
+        return nullptr;
+    }
+
+    _lru.splice(_lru.begin(), _lru, it->second.lruIterator);
+    return it->second.bytes;
+}
+
+void EncodedCache::evictUntilFits(const size_t incomingSize)
+{
+    while (!_lru.empty() && _currentSize + incomingSize > _maxSize)
+    {
+        const auto it = _entries.find(_lru.back());
+        _currentSize -= static_cast<size_t>(it->second.bytes->size());
+        _entries.erase(it);
+        _lru.pop_back();
+    }
+}
\ No newline at end of file
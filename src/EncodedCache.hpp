@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QByteArray>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Original file contents of recently used media, so re-decoding an evicted image doesn't touch the disk
+class EncodedCache
+{
+public:
+    explicit EncodedCache(size_t maxBytes);
+
+    // Returns the cached bytes, or reads and caches the file. Null if the file can't be read.
+    std::shared_ptr<const QByteArray> load(const std::string& path);
+    std::shared_ptr<const QByteArray> find(const std::string& path);
+    bool contains(const std::string& path);
+    size_t affordableEntries();
+    size_t currentSize() const { return _currentSize; }
+    size_t maxSize() const { return _maxSize; }
+    void setMaxSize(size_t bytes);
+    void remove(const std::string& path);
+    void clear();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const QByteArray> bytes;
+        std::list<std::string>::iterator lruIterator;
+    };
+
+    std::atomic_size_t _maxSize;
+    std::atomic_size_t _currentSize = 0;
+    size_t _loadedBytes = 0;
+    size_t _loadCount = 0;
+    std::unordered_map<std::string, Entry> _entries;
+    // Most recently used first
+    std::list<std::string> _lru;
+    std::mutex _mutex;
+
+    void evictUntilFits(size_t incomingSize);
+};
\ No newline at end of file
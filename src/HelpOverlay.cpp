@@ -17,6 +17,7 @@ const std::vector<std::string> CONTROLS_LINES = {
     "<b>O</b>: Open Directory",
     "<b>Delete</b>: Delete current item",
     "<b>I</b>: Toggle info overlay",
+    "<b>S</b>: Toggle cache statistics overlay",
     "<b>M</b>: Toggle mute (video)",
     "<b>Space</b>: Play/Pause (video)",
     "<b>.</b>: Mark image",
@@ -28,6 +29,7 @@ const std::vector<std::string> CONTROLS_LINES = {
     "<b>Num[2]</b>: Move left (image/animation)",
     "<b>Num[0]</b>: Reset transform (image/animation)",
     "<b>Ctrl+.</b>: Toggle marked-mode",
+    "<b>Ctrl+D</b>: Toggle display-resolution decoding",
     "<b>Ctrl+Arrow-Up</b>: Volume up",
     "<b>Ctrl+Arrow-Down</b>: Volume down",
     "<b>Ctrl+Shift+Numpad[+]</b>: Open upscale dialog",
@@ -11,13 +11,16 @@
 #include <ien/str_utils.hpp>
 
 #include <algorithm>
+#include <cstdio>
 #include <filesystem>
 #include <ranges>
 
 #include <omp.h>
 
+#include "DirectoryWatcher.hpp"
 #include "HelpOverlay.hpp"
 #include "PreviewStrip.hpp"
+#include "Resampler.hpp"
 #include "Utils.hpp"
 
 MainWindow::MainWindow(const std::string& target_path)
@@ -49,18 +52,17 @@ MainWindow::MainWindow(const std::string& target_path)
     _videoUpscaleSelectWidget->hide();
     _navigateSelectWidget->hide();
 
+    // Give decoded images back to the system when nobody has been looking for a while
+    _idleTimer = new QTimer(this);
+    _idleTimer->setSingleShot(true);
+    _idleTimer->setInterval(std::chrono::minutes(5));
+    connect(_idleTimer, &QTimer::timeout, this, [this] { _mediaWidget->trimCache(); });
+    _idleTimer->start();
+
     std::string targetFile;
     if (std::filesystem::is_directory(target_path))
     {
         _targetDir = target_path;
-        for (const auto& entry : std::filesystem::directory_iterator(target_path))
-        {
-            if (entry.is_regular_file())
-            {
-                const std::string file = entry.path().string();
-                targetFile = file;
-            }
-        }
     }
     else if (std::filesystem::is_regular_file(target_path))
     {
@@ -72,19 +74,20 @@ MainWindow::MainWindow(const std::string& target_path)
         throw std::logic_error(std::format("Attempt to load invalid path: {}", target_path));
     }
 
-    loadFiles();
-    const auto it = std::ranges::find_if(_fileList, [&](const FileEntry& entry) { return entry.path == targetFile; });
-    if (it == _fileList.cend())
-    {
-        _currentIndex = 0;
-        _mediaWidget->setMedia("");
-    }
-    else
-    {
-        _currentIndex = it - _fileList.begin();
-        _mediaWidget->setMedia(targetFile);
-    }
-    preCacheSurroundings();
+    _directoryWatcher = new DirectoryWatcher(this);
+    connect(_directoryWatcher, &DirectoryWatcher::filesChanged, this, [this](const std::vector<std::string>& paths) {
+        applyFileChanges(paths);
+    });
+    connect(_directoryWatcher, &DirectoryWatcher::overflowed, this, [this] {
+        if (_filtering)
+        {
+            _reloadDeferred = true;
+            return;
+        }
+        loadFiles(currentPath());
+    });
+
+    loadFiles(targetFile);
 
     loadLinks();
     std::vector<std::string> linksList;
@@ -95,6 +98,18 @@ MainWindow::MainWindow(const std::string& target_path)
     _navigateSelectWidget->setItems(linksList);
 
     connect(this, &MainWindow::currentIndexChanged, this, [this] { updateCurrentFileInfo(); });
+    // Media loads in the background, so its info is only complete once it is shown
+    connect(_mediaWidget, &MediaWidget::mediaChanged, this, [this] { updateCurrentFileInfo(); });
+    connect(
+        _mediaWidget,
+        &MediaWidget::mediaProbed,
+        this,
+        [this](const std::string& path, const MediaKind kind, const QSize dimensions) {
+            _directoryIndex.recordProbe(path, kind, dimensions);
+        });
+    connect(_mediaWidget, &MediaWidget::imageLookupResolved, this, [this](const bool hit) {
+        _prefetcher.recordLookup(hit);
+    });
 
     connect(_imageUpscaleSelectWidget, &ListSelectWidget::itemsSelected, this, [this](const auto& selected) {
         upscaleImage(_fileList[_currentIndex].path, selected[0]);
@@ -189,23 +204,37 @@ void MainWindow::processCopyToLinkKey(const QKeyEvent* ev)
     }
 }
 
-void MainWindow::preCacheSurroundings() const
+void MainWindow::preCacheSurroundings()
 {
-    constexpr int SURROUNDING_PRECACHE_WINDOW = 3;
-    for (int i = 1; i <= SURROUNDING_PRECACHE_WINDOW; ++i)
+    _prefetcher.notifyNavigation(_currentIndex);
+
+    const auto usage = _mediaWidget->cachedMediaProxy().usage();
+    const PrefetchBudget budget = { .maxCacheSize = usage.maxSize,
+                                    .averageEntrySize = usage.averageEntrySize,
+                                    .averageDecodeTime = usage.averageDecodeTime };
+
+    std::vector<std::pair<std::string, DecodePriority>> requests;
+    for (const auto& [index, priority] : _prefetcher.plan(_currentIndex, _fileList.size(), budget))
     {
-        const int64_t prevIndex = _currentIndex - i;
-        const int64_t nextIndex = _currentIndex + i;
+        requests.emplace_back(_fileList[index].path, priority);
+    }
 
-        if (prevIndex > 0)
-        {
-            _mediaWidget->cachedMediaProxy().preCacheImage(_fileList[prevIndex].path);
-        }
-        if (nextIndex < _fileList.size())
-        {
-            _mediaWidget->cachedMediaProxy().preCacheImage(_fileList[nextIndex].path);
-        }
+    // Anything still queued for the previous position is no longer worth decoding
+    const auto paths = requests | std::views::keys;
+    _mediaWidget->cachedMediaProxy().cancelPrecacheExcept({ paths.begin(), paths.end() });
+    for (const auto& [path, priority] : requests)
+    {
+        _mediaWidget->cachedMediaProxy().preCacheImage(path, priority);
+    }
+
+    // A much wider window only has its file contents read, so decodes there won't wait on the disk
+    std::vector<std::string> encodedPaths;
+    const size_t encodedCount = _mediaWidget->cachedMediaProxy().affordableEncodedEntries();
+    for (const auto index : _prefetcher.encodedPlan(_currentIndex, _fileList.size(), encodedCount))
+    {
+        encodedPaths.push_back(_fileList[index].path);
     }
+    _mediaWidget->cachedMediaProxy().preloadEncoded(encodedPaths);
 }
 
 void MainWindow::upscaleImage(const std::string& path, const std::string& model)
@@ -236,7 +265,7 @@ void MainWindow::upscaleImage(const std::string& path, const std::string& model)
         }
 
         const QImage img(QString::fromStdString(targetpath));
-        const QImage scaledImg = img.scaledToWidth(img.width() / 2, Qt::TransformationMode::SmoothTransformation);
+        const QImage scaledImg = resample(img, img.size() / 2, ResampleFilter::Area);
         scaledImg.save(QString::fromStdString(targetpath), extension.c_str(), 95);
         const auto mtime = ien::get_file_mtime(path);
         QFile::moveToTrash(QString::fromStdString(path));
@@ -247,12 +276,7 @@ void MainWindow::upscaleImage(const std::string& path, const std::string& model)
         QMetaObject::invokeMethod(this, [=, this] {
             _mediaWidget->showMessage("Finished!");
             _controls_disabled = false;
-            loadFiles();
-            updateCurrentFileInfo();
-            if (_fileList.size() > _currentIndex)
-            {
-                _mediaWidget->setMedia(_fileList[_currentIndex].path);
-            }
+            applyFileChanges({ path });
         });
     });
     thread.detach();
@@ -262,17 +286,6 @@ void MainWindow::navigateDir(const std::string& path)
 {
     _targetDir = path;
     loadFiles();
-    _currentIndex = 0;
-    _mediaWidget->cachedMediaProxy().clear();
-    if (_fileList.empty())
-    {
-        _mediaWidget->setMedia("");
-    }
-    else
-    {
-        _mediaWidget->setMedia(_fileList[_currentIndex].path);
-    }
-    emit currentIndexChanged(_currentIndex);
 }
 
 void MainWindow::deleteFile(const std::string& path)
@@ -321,17 +334,7 @@ void MainWindow::openDir()
     {
         _targetDir = dir.filesystemPath().string();
         loadFiles();
-        _currentIndex = 0;
-        if (_fileList.empty())
-        {
-            _mediaWidget->setMedia("");
-        }
-        else
-        {
-            _mediaWidget->setMedia(_fileList[_currentIndex].path);
-        }
     }
-    emit currentIndexChanged(_currentIndex);
 }
 
 void MainWindow::openNavigationDialog()
@@ -401,10 +404,15 @@ void MainWindow::handleCtrlInput(const int key)
         }
         else
         {
-            loadFiles();
+            loadFiles(currentPath());
         }
         break;
 
+    case Qt::Key_D:
+        _mediaWidget->toggleDisplayResolutionDecoding();
+        preCacheSurroundings();
+        break;
+
     case Qt::Key_Up:
         _mediaWidget->increaseVideoVolume(0.05F);
         break;
@@ -453,6 +461,9 @@ void MainWindow::handleStandardInput(const int key)
     case Qt::Key_I:
         toggleCurrentFileInfo();
         break;
+    case Qt::Key_S:
+        _mediaWidget->toggleCacheStatistics();
+        break;
     case Qt::Key_M:
         _mediaWidget->toggleMute();
         break;
@@ -494,7 +505,7 @@ void MainWindow::handleStandardInput(const int key)
         }
         else
         {
-            _previewStrip = new PreviewStrip(_mediaWidget->cachedMediaProxy(), this);
+            _previewStrip = new PreviewStrip(_mediaWidget->thumbnailStore(), this);
             _previewStrip->resize(size());
             connect(this, &MainWindow::resized, _previewStrip, [this](const QSize sz) { _previewStrip->resize(sz); });
             connect(this, &MainWindow::currentIndexChanged, _previewStrip, [this](const int64_t index) {
@@ -527,6 +538,23 @@ void MainWindow::handleStandardInput(const int key)
 
 void MainWindow::filterVideos()
 {
+    // Events are processed while other threads read _fileList, anything that would modify it waits until the end
+    _filtering = true;
+
+    // A scan still listing the directory finishes first, so that the filter sees every file and the directory index
+    // is updated with the full listing
+    if (_scanning)
+    {
+        _mediaWidget->showMessage("Filtering once loading has finished...");
+        while (_scanning)
+        {
+            QGuiApplication::processEvents(QEventLoop::WaitForMoreEvents);
+        }
+    }
+
+    // Picks up whatever was learned about the files while browsing, so that only the rest is read
+    _directoryIndex.restoreProbes(_fileList);
+
     std::vector<FileEntry> resultList;
     size_t total = _fileList.size();
     std::atomic_size_t current = 0;
@@ -541,7 +569,7 @@ void MainWindow::filterVideos()
 #pragma omp for schedule(dynamic)
             for (long i = 0; i < _fileList.size(); ++i)
             {
-                const auto& entry = _fileList[i];
+                auto& entry = _fileList[i];
                 if (omp_get_thread_num() == 0)
                 {
                     QMetaObject::invokeMethod(this, [&] {
@@ -549,7 +577,12 @@ void MainWindow::filterVideos()
                     });
                 }
 
-                if (isVideo(entry.path) || isAnimation(entry.path))
+                // Entries restored from the directory index were classified before, and need no I/O
+                if (!entry.kind)
+                {
+                    entry.kind = classifyMedia(entry.path);
+                }
+                if (*entry.kind == MediaKind::Video || *entry.kind == MediaKind::Animation)
                 {
                     threadResult.push_back(entry);
                 }
@@ -567,11 +600,29 @@ void MainWindow::filterVideos()
     }
     task_thread.join();
 
+    for (const auto& entry : _fileList)
+    {
+        _directoryIndex.recordProbe(entry.path, *entry.kind, {});
+    }
+    _directoryIndex.save();
+
     _mediaWidget->showMessage(QString::fromStdString(std::format("Filtered {} video files", resultList.size())));
 
     _fileList = std::move(resultList);
     _currentIndex = 0;
-    _mediaWidget->setMedia(_fileList[_currentIndex].path);
+    _videoFilter = true;
+    _prefetcher.reset();
+    _mediaWidget->setMedia(currentPath());
+
+    _filtering = false;
+    if (std::exchange(_reloadDeferred, false))
+    {
+        loadFiles(currentPath());
+    }
+    else if (!_deferredChanges.empty())
+    {
+        applyFileChanges(std::exchange(_deferredChanges, {}));
+    }
 }
 
 void MainWindow::upscaleVideo(const std::string& path, const std::string& modelStr)
@@ -588,8 +639,7 @@ void MainWindow::upscaleVideo(const std::string& path, const std::string& modelS
             return;
         }
 
-        const auto extension = ien::str_tolower(ien::get_file_extension(path)).substr(1);
-        if (extension != ".mp4")
+        if (ien::str_tolower(ien::get_file_extension(path)) != ".mp4")
         {
             target_path += ".mp4";
             out_path += ".mp4";
@@ -629,14 +679,15 @@ void MainWindow::upscaleVideo(const std::string& path, const std::string& modelS
         QMetaObject::invokeMethod(this, [=, this] {
             _mediaWidget->showMessage("Finished!");
             _controls_disabled = false;
-            loadFiles();
-            updateCurrentFileInfo();
-            if (_fileList.size() > _currentIndex)
+            // A container change renames the file, the result takes the original's place in whatever view listed it
+            if (out_path != path)
             {
-                _mediaWidget->cachedMediaProxy().clear();
-                _fileList[_currentIndex].path = out_path;
-                _mediaWidget->setMedia(out_path);
+                if (const auto it = std::ranges::find(_fileList, path, &FileEntry::path); it != _fileList.end())
+                {
+                    it->path = out_path;
+                }
             }
+            applyFileChanges({ path, out_path });
         });
     });
     thread.detach();
@@ -664,6 +715,8 @@ void MainWindow::filterMarkedFiles()
         return;
     }
 
+    stopScan();
+
     std::vector<FileEntry> markedEntries;
     markedEntries.reserve(_markedFiles.size());
     for (const auto& index : _markedFiles)
@@ -674,6 +727,7 @@ void MainWindow::filterMarkedFiles()
 
     _fileList = std::move(markedEntries);
     _currentIndex = 0;
+    _prefetcher.reset();
 
     _mediaWidget->cachedMediaProxy().clear();
     _mediaWidget->setMedia(_fileList[_currentIndex].path);
@@ -684,7 +738,9 @@ void MainWindow::filterMarkedFiles()
 
 void MainWindow::keyPressEvent(QKeyEvent* ev)
 {
-    if (_controls_disabled)
+    _idleTimer->start();
+
+    if (_controls_disabled || _filtering)
     {
         return;
     }
@@ -731,9 +787,8 @@ void MainWindow::keyPressEvent(QKeyEvent* ev)
             }
             else
             {
-                loadFiles();
+                loadFiles(currentPath());
             }
-            _videoFilter = !_videoFilter;
         }
         else
         {
@@ -774,29 +829,344 @@ void MainWindow::resizeEvent(QResizeEvent* ev)
     emit resized(ev->size());
 }
 
-void MainWindow::loadFiles()
+void MainWindow::changeEvent(QEvent* ev)
+{
+    if (ev->type() == QEvent::WindowStateChange && isMinimized())
+    {
+        _mediaWidget->trimCache();
+    }
+    QMainWindow::changeEvent(ev);
+}
+
+void MainWindow::closeEvent(QCloseEvent* ev)
+{
+    std::printf("Cache statistics:\n%s", _mediaWidget->cacheStatistics().c_str());
+    QMainWindow::closeEvent(ev);
+}
+
+void MainWindow::loadFiles(const std::string& focusPath)
 {
+    _prefetcher.reset();
     _mediaWidget->cachedMediaProxy().clear();
     _fileList.clear();
-    for (const auto& entry : std::filesystem::directory_iterator(_targetDir))
+    _currentIndex = 0;
+    _currentMode = GalleryMode::STANDARD;
+    _videoFilter = false;
+    _provisionalPath.clear();
+    _autoShownPath.clear();
+    _deferredChanges.clear();
+    // Watching starts before the listing is read, so nothing changed in between goes unnoticed
+    _directoryWatcher->watch(_targetDir);
+
+    if (auto indexed = _directoryIndex.open(_targetDir))
     {
-        if (entry.is_regular_file() && hasMediaExtension(entry.path().string()))
+        _directoryScanner.stop();
+        ++_scanGeneration;
+        _scanning = false;
+        _fileList = std::move(*indexed);
+        std::ranges::sort(_fileList, [](const FileEntry& lhs, const FileEntry& rhs) { return lhs.mtime > rhs.mtime; });
+
+        const auto it = std::ranges::find(_fileList, focusPath, &FileEntry::path);
+        _currentIndex = it == _fileList.end() ? 0 : it - _fileList.begin();
+        _mediaWidget->setMedia(currentPath());
+        emit currentIndexChanged(_currentIndex);
+        preCacheSurroundings();
+        _mediaWidget->showMessage(QString::fromStdString(std::format("Loaded {} files", _fileList.size())));
+        revalidateListing();
+        return;
+    }
+
+    // The focused file is shown right away instead of waiting for the scan to list it
+    std::error_code error;
+    if (!focusPath.empty() && hasMediaExtension(focusPath))
+    {
+        if (std::filesystem::is_regular_file(focusPath, error))
         {
-            const auto path = entry.path().string();
-            const auto mtime = ien::get_file_mtime(path);
-            _fileList.push_back(FileEntry{ .path = path, .mtime = mtime });
+            _fileList.push_back(FileEntry{ .path = focusPath, .mtime = ien::get_file_mtime(focusPath) });
+            _provisionalPath = focusPath;
         }
     }
+    _mediaWidget->setMedia(_provisionalPath);
+    emit currentIndexChanged(_currentIndex);
 
-    std::ranges::sort(_fileList, [](const FileEntry& lhs, const FileEntry& rhs) { return lhs.mtime > rhs.mtime; });
+    const uint64_t generation = ++_scanGeneration;
+    _scanning = true;
+    _directoryScanner.start(
+        _targetDir,
+        [this, generation](std::vector<FileEntry>&& files) {
+            QMetaObject::invokeMethod(this, [this, generation, files = std::move(files)]() mutable {
+                if (generation == _scanGeneration)
+                {
+                    addScannedFiles(std::move(files));
+                }
+            });
+        },
+        [this, generation] {
+            QMetaObject::invokeMethod(this, [this, generation] {
+                if (generation == _scanGeneration)
+                {
+                    finishScan();
+                }
+            });
+        });
+}
 
-    _currentMode = GalleryMode::STANDARD;
+void MainWindow::addScannedFiles(std::vector<FileEntry>&& files)
+{
+    _directoryIndex.restoreProbes(files);
+
+    const auto newerFirst = [](const FileEntry& lhs, const FileEntry& rhs) { return lhs.mtime > rhs.mtime; };
+    const bool wasEmpty = _fileList.empty();
+    const FileEntry current = wasEmpty ? FileEntry{} : _fileList[_currentIndex];
+
+    if (!_provisionalPath.empty() && std::ranges::find(files, _provisionalPath, &FileEntry::path) != files.end())
+    {
+        std::erase_if(_fileList, [this](const FileEntry& entry) { return entry.path == _provisionalPath; });
+        _provisionalPath.clear();
+    }
 
+    std::ranges::sort(files, newerFirst);
+    const auto previousSize = static_cast<ptrdiff_t>(_fileList.size());
+    std::ranges::move(files, std::back_inserter(_fileList));
+    std::inplace_merge(_fileList.begin(), _fileList.begin() + previousSize, _fileList.end(), newerFirst);
+
+    if (wasEmpty)
+    {
+        _currentIndex = 0;
+        _autoShownPath = _fileList.front().path;
+        _mediaWidget->setMedia(_autoShownPath);
+        emit currentIndexChanged(_currentIndex);
+        preCacheSurroundings();
+    }
+    else
+    {
+        // Only entries sharing the current mtime need comparing by path to find where it moved
+        const auto [first, last] = std::ranges::equal_range(_fileList, current, newerFirst);
+        auto it = std::ranges::find(first, last, current.path, &FileEntry::path);
+        if (it == last)
+        {
+            it = std::ranges::find(_fileList, current.path, &FileEntry::path);
+        }
+        _currentIndex = it == _fileList.end() ? 0 : it - _fileList.begin();
+    }
+    _mediaWidget->showMessage(QString::fromStdString(std::format("Loading... {} files", _fileList.size())));
+}
+
+void MainWindow::finishScan()
+{
+    _provisionalPath.clear();
+    _directoryIndex.update(_fileList);
+    if (_fileList.empty())
+    {
+        _mediaWidget->setMedia("");
+    }
+    else if (_currentIndex != 0 && _fileList[_currentIndex].path == _autoShownPath)
+    {
+        _currentIndex = 0;
+        _mediaWidget->setMedia(_fileList[_currentIndex].path);
+    }
+    _autoShownPath.clear();
+
+    emit currentIndexChanged(_currentIndex);
+    preCacheSurroundings();
     _mediaWidget->showMessage(QString::fromStdString(std::format("Loaded {} files", _fileList.size())));
+
+    _scanning = false;
+    if (!_deferredChanges.empty())
+    {
+        applyFileChanges(std::exchange(_deferredChanges, {}));
+    }
+}
+
+void MainWindow::revalidateListing()
+{
+    // The restored listing stays in use meanwhile, watcher changes wait until the scan has been compared with it
+    const uint64_t generation = ++_scanGeneration;
+    _scanning = true;
+    _revalidatedFiles.clear();
+    _directoryScanner.start(
+        _targetDir,
+        [this, generation](std::vector<FileEntry>&& files) {
+            QMetaObject::invokeMethod(this, [this, generation, files = std::move(files)]() mutable {
+                if (generation == _scanGeneration)
+                {
+                    std::ranges::move(files, std::back_inserter(_revalidatedFiles));
+                }
+            });
+        },
+        [this, generation] {
+            QMetaObject::invokeMethod(this, [this, generation] {
+                if (generation == _scanGeneration)
+                {
+                    finishRevalidation();
+                }
+            });
+        });
+}
+
+void MainWindow::finishRevalidation()
+{
+    auto scanned = std::exchange(_revalidatedFiles, {});
+
+    // Files whose stat no longer matches the listing, plus those that appeared or disappeared
+    std::unordered_map<std::string, const FileEntry*> listed;
+    for (const auto& entry : _fileList)
+    {
+        listed.emplace(entry.path, &entry);
+    }
+    std::vector<std::string> changes;
+    for (const auto& entry : scanned)
+    {
+        const auto it = listed.find(entry.path);
+        if (it == listed.end() || it->second->mtime != entry.mtime || it->second->size != entry.size)
+        {
+            changes.push_back(entry.path);
+        }
+        if (it != listed.end())
+        {
+            listed.erase(it);
+        }
+    }
+    std::ranges::copy(listed | std::views::keys, std::back_inserter(changes));
+
+    // Probes are only carried over for files that are unchanged, the rest get classified again when needed
+    _directoryIndex.restoreProbes(scanned);
+    _directoryIndex.update(scanned);
+
+    _scanning = false;
+    std::ranges::move(changes, std::back_inserter(_deferredChanges));
+    if (!_deferredChanges.empty())
+    {
+        applyFileChanges(std::exchange(_deferredChanges, {}));
+    }
+}
+
+void MainWindow::stopScan()
+{
+    _directoryScanner.stop();
+    ++_scanGeneration;
+    _scanning = false;
+    _deferredChanges.clear();
+    _revalidatedFiles.clear();
+    _provisionalPath.clear();
+    _autoShownPath.clear();
+}
+
+void MainWindow::applyFileChanges(const std::vector<std::string>& paths)
+{
+    if (_scanning || _filtering)
+    {
+        std::ranges::copy(paths, std::back_inserter(_deferredChanges));
+        return;
+    }
+
+    const auto newerFirst = [](const FileEntry& lhs, const FileEntry& rhs) { return lhs.mtime > rhs.mtime; };
+    // New files only join the full listing, filtered and multi-directory views just follow their own entries
+    const bool acceptsNewFiles = _currentMode == GalleryMode::STANDARD && !_videoFilter;
+    const std::string shownPath = currentPath();
+    const int64_t shownIndex = _currentIndex;
+
+    std::vector<std::string> markedPaths;
+    for (const auto index : _markedFiles)
+    {
+        if (index < _fileList.size())
+        {
+            markedPaths.push_back(_fileList[index].path);
+        }
+    }
+
+    std::unordered_map<std::string, std::optional<FileEntry>> states;
+    for (const auto& path : paths)
+    {
+        if (hasMediaExtension(path))
+        {
+            states.emplace(path, statFile(path));
+        }
+    }
+
+    // Changed entries are taken out to be merged back in at their new position, unchanged ones stay untouched
+    std::unordered_set<std::string> listed;
+    std::erase_if(_fileList, [&](const FileEntry& entry) {
+        const auto it = states.find(entry.path);
+        if (it == states.end())
+        {
+            return false;
+        }
+        // Upscales restore the original mtime, so the size tells rewritten files apart too
+        if (it->second && it->second->mtime == entry.mtime && it->second->size == entry.size)
+        {
+            states.erase(it);
+            return false;
+        }
+        listed.insert(entry.path);
+        return true;
+    });
+    if (states.empty())
+    {
+        return;
+    }
+
+    std::vector<FileEntry> changed;
+    std::vector<std::string> removed;
+    std::vector<FileEntry> added;
+    for (auto& [path, state] : states)
+    {
+        _mediaWidget->cachedMediaProxy().invalidate(path);
+        if (!state)
+        {
+            removed.push_back(path);
+            continue;
+        }
+        changed.push_back(*state);
+        if (acceptsNewFiles || listed.contains(path))
+        {
+            added.push_back(std::move(*state));
+        }
+    }
+    _directoryIndex.patch(changed, removed);
+
+    std::ranges::sort(added, newerFirst);
+    const auto previousSize = static_cast<ptrdiff_t>(_fileList.size());
+    std::ranges::move(added, std::back_inserter(_fileList));
+    std::inplace_merge(_fileList.begin(), _fileList.begin() + previousSize, _fileList.end(), newerFirst);
+
+    _markedFiles.clear();
+    for (const auto& path : markedPaths)
+    {
+        if (const auto it = std::ranges::find(_fileList, path, &FileEntry::path); it != _fileList.end())
+        {
+            _markedFiles.emplace(it - _fileList.begin());
+        }
+    }
+
+    const auto shown = std::ranges::find(_fileList, shownPath, &FileEntry::path);
+    if (shown != _fileList.end())
+    {
+        _currentIndex = shown - _fileList.begin();
+    }
+    else
+    {
+        // The next file takes the place of one that went away
+        _currentIndex = _fileList.empty() ? 0 : std::min<int64_t>(shownIndex, static_cast<int64_t>(_fileList.size()) - 1);
+    }
+    if (shown == _fileList.end() || states.contains(shownPath))
+    {
+        _mediaWidget->setMedia(currentPath());
+    }
+    emit currentIndexChanged(_currentIndex);
+    preCacheSurroundings();
+}
+
+std::string MainWindow::currentPath() const
+{
+    return _fileList.size() > static_cast<size_t>(_currentIndex) ? _fileList[_currentIndex].path : std::string();
 }
 
 void MainWindow::loadFilesMulti(const std::vector<std::string>& abs_directories)
 {
+    stopScan();
+    _directoryWatcher->watch({});
+    _prefetcher.reset();
     _mediaWidget->cachedMediaProxy().clear();
     _fileList.clear();
 
@@ -812,16 +1182,7 @@ void MainWindow::loadFilesMulti(const std::vector<std::string>& abs_directories)
     std::vector<std::vector<FileEntry>> dir_entry_lists;
     for (const auto& dir : abs_directories)
     {
-        std::vector<FileEntry>& current_list = dir_entry_lists.emplace_back();
-        for (const auto& entry :
-             std::filesystem::directory_iterator(dir) | std::views::filter([](const auto& e) {
-                 return e.is_regular_file() && hasMediaExtension(e.path().string());
-             }))
-        {
-            const auto path = entry.path().string();
-            const auto mtime = ien::get_file_mtime(path);
-            current_list.push_back(FileEntry{ .path = path, .mtime = mtime });
-        }
+        dir_entry_lists.push_back(scanDirectory(dir));
     }
 
     for (size_t i = 0; i < dir_entry_lists.size() - 1; ++i)
@@ -943,13 +1304,7 @@ void MainWindow::toggleFullScreen()
 
 void MainWindow::loadLinks()
 {
-    auto path = ien::get_current_user_homedir();
-    if (!path.ends_with("/") & !path.ends_with("\\"))
-    {
-        path += std::filesystem::path::preferred_separator;
-    }
-    path += ".config/igal_qt/links.txt";
-    _links = getLinksFromFile(path);
+    _links = getLinksFromFile(getConfigFilePath("links.txt"));
 }
 
 void MainWindow::toggleCurrentFileInfo() const
@@ -964,8 +1319,7 @@ void MainWindow::toggleCurrentFileInfo() const
         {
             return;
         }
-        const std::string info = getFileInfoString(_fileList[_currentIndex].path, _mediaWidget->currentMediaSource());
-        _mediaWidget->showInfo(QString::fromStdString(info));
+        _mediaWidget->showInfo(QString::fromStdString(currentFileInfo()));
     }
 }
 
@@ -973,7 +1327,12 @@ void MainWindow::updateCurrentFileInfo() const
 {
     if (_mediaWidget->isInfoShown())
     {
-        const std::string info = getFileInfoString(_fileList[_currentIndex].path, _mediaWidget->currentMediaSource());
-        _mediaWidget->showInfo(QString::fromStdString(info));
+        _mediaWidget->showInfo(QString::fromStdString(currentFileInfo()));
     }
+}
+
+std::string MainWindow::currentFileInfo() const
+{
+    return getFileInfoString(_fileList[_currentIndex].path, _mediaWidget->currentMediaSource()) +
+           std::format("<b>Prefetch hits</b>: <i>{:.0f}%</i><br>", _prefetcher.hitRate() * 100);
 }
\ No newline at end of file
@@ -3,20 +3,15 @@
 #include <QMainWindow>
 #include <QStackedLayout>
 
+#include "DirectoryIndex.hpp"
+#include "DirectoryScanner.hpp"
 #include "ListSelectWidget.hpp"
 #include "MediaWidget.hpp"
+#include "Prefetcher.hpp"
 
 #include <unordered_map>
 #include <vector>
 
-struct FileEntry
-{
-    std::string path;
-    time_t mtime;
-
-    bool operator==(const FileEntry& rhs) const { return path == rhs.path && mtime && rhs.mtime; }
-};
-
 enum class GalleryMode
 {
     STANDARD,
@@ -24,6 +19,7 @@ enum class GalleryMode
     MARKED
 };
 
+class DirectoryWatcher;
 class HelpOverlay;
 class PreviewStrip;
 
@@ -37,6 +33,8 @@ public:
 protected:
     void keyPressEvent(QKeyEvent* ev) override;
     void resizeEvent(QResizeEvent* ev) override;
+    void changeEvent(QEvent* ev) override;
+    void closeEvent(QCloseEvent* ev) override;
 
 signals:
     void currentIndexChanged(int64_t index);
@@ -57,14 +55,44 @@ private:
     ListSelectWidget* _navigateSelectWidget = nullptr;
     HelpOverlay* _helpOverlay = nullptr;
     PreviewStrip* _previewStrip = nullptr;
+    QTimer* _idleTimer = nullptr;
     bool _controls_disabled = false;
     float _currentZoom = 1.0f;
     QPointF _currentTranslation = { 0.0f, 0.0f };
     GalleryMode _currentMode = GalleryMode::STANDARD;
     bool _videoFilter = false;
     std::unordered_set<size_t> _markedFiles;
+    Prefetcher _prefetcher;
+    // Results of a scan that was stopped or replaced carry an older value and are dropped
+    uint64_t _scanGeneration = 0;
+    // Shown before the scan reaches it, replaced by the scanned entry once it arrives
+    std::string _provisionalPath;
+    // Shown by the first scanned batch, swapped for the newest file at the end unless the user moved on
+    std::string _autoShownPath;
+    bool _scanning = false;
+    // Collected by the scan that revalidates a listing restored from the directory index
+    std::vector<FileEntry> _revalidatedFiles;
+    // Reported while a scan or the video filter was running, applied once it is complete
+    std::vector<std::string> _deferredChanges;
+    // Set for the whole of filterVideos(), which processes events while other threads read _fileList
+    bool _filtering = false;
+    // The watcher lost changes during the video filter, the directory is read again once it is done
+    bool _reloadDeferred = false;
+    DirectoryIndex _directoryIndex;
+    DirectoryWatcher* _directoryWatcher = nullptr;
+    // Declared last so that the scan thread is stopped before the state its callbacks use goes away
+    DirectoryScanner _directoryScanner;
 
-    void loadFiles();
+    // Streams the target directory into _fileList, keeping focusPath shown if given
+    void loadFiles(const std::string& focusPath = {});
+    void addScannedFiles(std::vector<FileEntry>&& files);
+    void finishScan();
+    void revalidateListing();
+    void finishRevalidation();
+    void stopScan();
+    // Brings _fileList, the caches and the directory index up to date with files that changed on disk
+    void applyFileChanges(const std::vector<std::string>& paths);
+    std::string currentPath() const;
     void loadFilesMulti(const std::vector<std::string>& abs_directories);
     void nextEntry(int times = 1);
     void prevEntry(int times = 1);
@@ -75,8 +103,9 @@ private:
     void loadLinks();
     void toggleCurrentFileInfo() const;
     void updateCurrentFileInfo() const;
+    std::string currentFileInfo() const;
     void processCopyToLinkKey(const QKeyEvent* ev);
-    void preCacheSurroundings() const;
+    void preCacheSurroundings();
     void upscaleImage(const std::string& path, const std::string& model);
     void navigateDir(const std::string& path);
     void deleteFile(const std::string& path);
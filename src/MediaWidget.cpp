@@ -3,20 +3,21 @@
 #include <QPaintEvent>
 #include <QPainter>
 
-#include <ien/math_utils.hpp>
-
+#include <algorithm>
 #include <filesystem>
 
+#include "EmbeddedPreview.hpp"
 #include "Utils.hpp"
 
-#include <ien/str_utils.hpp>
-#include <ien/fs_utils.hpp>
-
 #include <QApplication>
 
 MediaWidget::MediaWidget(QWidget* parent)
     : QWidget(parent)
-    , _cachedMediaProxy(1024)
+    , _settings(getSettingsFromFile(getConfigFilePath("settings.txt")))
+    , _cachedMediaProxy(_settings.cacheBudgetMB, _settings.encodedCacheBudgetMB)
+    , _renderCache(_settings.cacheBudgetMB * 1024 * 1024 / 8)
+    , _animationRenderBudget(_settings.cacheBudgetMB * 1024 * 1024 / 8)
+    , _loadQueue(1)
 {
     setAutoFillBackground(true);
 
@@ -28,9 +29,11 @@ MediaWidget::MediaWidget(QWidget* parent)
 
     _imageLabel = new QLabel(this);
     _infoOverlay = new InfoOverlayWidget(this);
+    _statsOverlay = new StatsOverlayWidget([this] { return cacheStatistics(); }, this);
 
     _mainLayout->addWidget(_imageLabel);
     _mainLayout->addWidget(_infoOverlay);
+    _mainLayout->addWidget(_statsOverlay);
 
     _imageLabel->setAlignment(Qt::AlignVCenter | Qt::AlignHCenter);
     _imageLabel->setMinimumSize(600, 400);
@@ -41,92 +44,63 @@ MediaWidget::MediaWidget(QWidget* parent)
     _mainLayout->setCurrentWidget(_infoOverlay);
 
     QTimer::singleShot(1000, [this] { initVideoPlayer(); });
-}
 
-void MediaWidget::setMedia(const std::string& source)
-{
-    qDebug() << "Loading media: " << source;
-    _target = source;
+    // Queued even when a cancellation runs on the GUI thread, so the view never changes under the caller
+    _cachedMediaProxy.setDecodeCallback(
+        [this] { QMetaObject::invokeMethod(this, [this] { onImageDecoded(); }, Qt::QueuedConnection); });
 
-    if (_videoPlayer)
-    {
-        _videoPlayer->hide();
-        _videoPlayer->mediaPlayer()->stop();
-    }
+    _refineTimer = new QTimer(this);
+    _refineTimer->setSingleShot(true);
+    _refineTimer->setInterval(150);
+    connect(_refineTimer, &QTimer::timeout, this, [this] { updateTransform(); });
 
-    _imageLabel->hide();
-    if (_animation)
+    if (_settings.adaptiveCacheBudget)
     {
-        _animation->stop();
+        _memoryTimer = new QTimer(this);
+        _memoryTimer->setInterval(2000);
+        connect(_memoryTimer, &QTimer::timeout, this, [this] { adjustCacheBudget(); });
+        _memoryTimer->start();
+        adjustCacheBudget();
     }
+}
 
-    if (isVideo(_target))
-    {
-        _currentMediaType = CurrentMediaType::Video;
-
-        if (!_videoPlayer)
-        {
-            initVideoPlayer();
-        }
-        _videoPlayer->setMedia(source);
-        _videoPlayer->show();
-    }
-    else if (isAnimation(_target))
-    {
-        auto real_source = source;
-        if (ien::str_tolower(_target).ends_with(".png"))
-        {
-            real_source = std::format("/tmp/igal_qt{}.gif", std::filesystem::absolute(_target).string());
-            if (std::filesystem::file_size(real_source) == 0)
+void MediaWidget::setMedia(const std::string& source)
+{
+    qDebug() << "Loading media: " << source;
+    const uint64_t generation = ++_mediaGeneration;
+    _cachedMediaProxy.setDisplayedImage(source);
+
+    // Sniffing the file can block on slow storage, so the current media stays up until the new one is ready.
+    // _target keeps naming the shown media until then, so zooming it meanwhile still loads the right file.
+    // Pushing under the same key replaces a request that hasn't started yet.
+    _loadQueue.push(
+        "media",
+        DecodePriority::Current,
+        [this, source, generation] {
+            if (generation != _mediaGeneration)
             {
-                _currentMediaType = CurrentMediaType::Image;
-                _image = _cachedMediaProxy.getImage(source).get().image();
-                _imageLabel->setMovie(nullptr);
-                updateTransform();
-                _imageLabel->show();
                 return;
             }
-            if (!std::filesystem::exists(real_source))
-            {
-                std::filesystem::create_directories(ien::get_file_directory(real_source));
-                runCommand("ffmpeg", { "-n", "-i", _target, real_source }, []([[maybe_unused]] const std::string&) {});
-                if (!std::filesystem::exists(real_source) || std::filesystem::file_size(real_source) == 0)
+
+            auto loaded = std::make_shared<LoadedMedia>(loadMedia(source));
+            QMetaObject::invokeMethod(this, [this, generation, loaded] {
+                // Results of requests overtaken by newer ones are dropped
+                if (generation == _mediaGeneration)
                 {
-                    _currentMediaType = CurrentMediaType::Image;
-                    _image = _cachedMediaProxy.getImage(source).get().image();
-                    _imageLabel->setMovie(nullptr);
-                    updateTransform();
-                    _imageLabel->show();
-                    return;
+                    showMedia(*loaded);
                 }
-            }
-        }
-        _currentMediaType = CurrentMediaType::Animation;
-        _animation = CachedMediaProxy::getAnimation(real_source);
-        _animation->setCacheMode(QMovie::CacheMode::CacheAll);
-        std::printf("Frame count: %d\n", _animation->frameCount());
-        connectAnimationSignals();
-        _imageLabel->setPixmap({});
-        _animation->start();
-        syncAnimationSize();
-        _imageLabel->show();
-    }
-    else if (isImage(_target))
-    {
-        _currentMediaType = CurrentMediaType::Image;
-        _image = _cachedMediaProxy.getImage(source).get().image();
-        _imageLabel->setMovie(nullptr);
-        updateTransform();
-        _imageLabel->show();
-    }
+            });
+        },
+        {});
 }
 
-std::variant<const QImage*, const QMovie*, const QMediaPlayer*> MediaWidget::currentMediaSource() const
+std::variant<QSize, const AnimationPlayer*, const QMediaPlayer*> MediaWidget::currentMediaSource() const
 {
     switch (_currentMediaType)
     {
     case CurrentMediaType::Image:
-        return _image.get();
+        // Placeholders, reduced decodes and overviews all stand in for the original dimensions
+        return _imageOriginalSize;
     case CurrentMediaType::Animation:
         return _animation.get();
     case CurrentMediaType::Video:
@@ -196,39 +170,103 @@ void MediaWidget::togglePlayPauseVideo() const
     }
 }
 
-void MediaWidget::updateTransform()
+void MediaWidget::updateTransform(const RenderQuality quality)
 {
+    if (_currentMediaType == CurrentMediaType::Animation)
+    {
+        _currentTranslation.setX(std::clamp(_currentTranslation.x(), -1.0, 1.0));
+        _currentTranslation.setY(std::clamp(_currentTranslation.y(), -1.0, 1.0));
+        if (_animation)
+        {
+            _imageLabel->setPixmap(_animation->renderedFrame(currentRenderParameters(), quality));
+            _imageLabel->setScaledContents(true);
+        }
+        return;
+    }
+
     if (!_image)
     {
         return;
     }
 
+    bool needsDetail = false;
+    if (_currentMediaType == CurrentMediaType::Image && !_isPlaceholder && _imageOriginalSize != _image->size())
+    {
+        const QSize requiredSize =
+            _imageOriginalSize.scaled(size() * devicePixelRatio() * _currentZoom, Qt::KeepAspectRatio);
+        needsDetail = requiredSize.width() > _image->width();
+        if (needsDetail && !_tiled)
+        {
+            loadFullImage();
+        }
+    }
+
     _currentTranslation.setX(std::clamp(_currentTranslation.x(), -1.0, 1.0));
     _currentTranslation.setY(std::clamp(_currentTranslation.y(), -1.0, 1.0));
 
-    const auto pixmapSize = _image->size();
-    const auto sourceRectSize = size().scaled(pixmapSize, Qt::KeepAspectRatioByExpanding) / _currentZoom;
-    const auto diff = pixmapSize - sourceRectSize;
+    const auto parameters = currentRenderParameters();
+    if (_currentMediaType != CurrentMediaType::Image)
+    {
+        _imageLabel->setPixmap(QPixmap::fromImage(renderImage(*_image, parameters, quality)));
+        _imageLabel->setScaledContents(true);
+        return;
+    }
 
-    const float half_width = static_cast<float>(diff.width()) / 2;
-    const float half_height = static_cast<float>(diff.height()) / 2;
+    if (_isPlaceholder)
+    {
+        _imageLabel->setPixmap(QPixmap::fromImage(renderImage(*_image, parameters, quality)));
+        _imageLabel->setScaledContents(true);
+        return;
+    }
+
+    // Keyed by the image's cache key rather than its path, so reloading a changed file never shows a stale view
+    const qint64 imageKey = _image->cacheKey();
+    auto pixmap = _renderCache.find(imageKey, parameters);
+    _pendingTiles.clear();
+    if (!pixmap && !_preRendered && quality == RenderQuality::Fast)
+    {
+        // Neither cached nor tiled, the smooth pass takes care of both once input goes idle
+        _imageLabel->setPixmap(QPixmap::fromImage(renderImage(*_image, parameters, quality)));
+        _imageLabel->setScaledContents(true);
+        return;
+    }
 
-    const float translateX = ien::remap(static_cast<float>(_currentTranslation.x()), -1, 1, -half_width, half_width);
-    const float translateY = ien::remap(static_cast<float>(_currentTranslation.y()), -1, 1, -half_height, half_height);
+    if (!pixmap)
+    {
+        const auto tiles = needsDetail && _tiled ? renderVisibleTiles(parameters) : std::nullopt;
+        if (tiles)
+        {
+            pixmap = QPixmap::fromImage(*tiles);
+        }
+        else if (_preRendered)
+        {
+            pixmap = QPixmap::fromImage(*_preRendered);
+        }
+        else
+        {
+            // Large downscales resample from the nearest pyramid level instead of the full image
+            const auto source = _pyramid ? _pyramid->levelFor(renderScale(_image->size(), parameters)) : _image;
+            pixmap = QPixmap::fromImage(renderImage(*source, parameters));
+        }
 
-    const QRect sourceRect(
-        static_cast<int>(half_width + translateX),
-        static_cast<int>(half_height + translateY),
-        sourceRectSize.width(),
-        sourceRectSize.height());
+        // The overview standing in for tiles that are still decoding gets replaced as soon as they are ready
+        if (_pendingTiles.empty())
+        {
+            _renderCache.insert(imageKey, parameters, *pixmap);
+        }
+    }
+    _preRendered.reset();
 
-    const auto imageRect = _image->copy(sourceRect);
-    const QSize targetSize = imageRect.size().scaled(size() * devicePixelRatio(), Qt::KeepAspectRatio);
-    const auto pixmap = QPixmap::fromImage(imageRect.scaled(targetSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
-    _imageLabel->setPixmap(pixmap);
+    _imageLabel->setPixmap(*pixmap);
     _imageLabel->setScaledContents(true);
 }
 
+void MediaWidget::updateTransformInteractive()
+{
+    updateTransform(RenderQuality::Fast);
+    _refineTimer->start();
+}
+
 void MediaWidget::paintEvent(QPaintEvent* ev)
 {
     if (!std::filesystem::exists(_target))
@@ -255,14 +293,20 @@ void MediaWidget::paintEvent(QPaintEvent* ev)
 
 void MediaWidget::resizeEvent(QResizeEvent* ev)
 {
+    _cachedMediaProxy.setRenderViewport(ev->size(), devicePixelRatio());
+    if (_displayResolutionDecoding)
+    {
+        _cachedMediaProxy.setDisplayDecodeSize(ev->size() * devicePixelRatio());
+    }
+
     if (_currentMediaType == CurrentMediaType::Image)
     {
-        updateTransform();
+        updateTransformInteractive();
         _imageLabel->setMinimumSize(600, 400);
     }
     else if (_currentMediaType == CurrentMediaType::Animation)
     {
-        syncAnimationSize();
+        updateTransformInteractive();
         _imageLabel->setMinimumSize(600, 400);
     }
     else if (_currentMediaType == CurrentMediaType::Video && _videoPlayer)
@@ -277,40 +321,70 @@ CachedMediaProxy& MediaWidget::cachedMediaProxy()
     return _cachedMediaProxy;
 }
 
+ThumbnailStore& MediaWidget::thumbnailStore()
+{
+    return _thumbnailStore;
+}
+
+void MediaWidget::trimCache()
+{
+    _cachedMediaProxy.trim();
+    _renderCache.clear();
+    if (_animation)
+    {
+        _animation->releaseRenderedFrames();
+    }
+}
+
+void MediaWidget::toggleCacheStatistics() const
+{
+    _statsOverlay->toggle();
+}
+
+std::string MediaWidget::cacheStatistics()
+{
+    auto result = _cachedMediaProxy.statisticsString();
+    if (_currentMediaType == CurrentMediaType::Animation && _animation)
+    {
+        result += "\n" + _animation->frameTimingString();
+    }
+    return result;
+}
+
 void MediaWidget::zoomIn(const float amount)
 {
     _currentZoom += amount;
-    updateTransform();
+    updateTransformInteractive();
 }
 
 void MediaWidget::zoomOut(const float amount)
 {
     _currentZoom = std::max(1.0f, _currentZoom - amount);
-    updateTransform();
+    updateTransformInteractive();
 }
 
 void MediaWidget::translateLeft(const float amount)
 {
     _currentTranslation -= QPointF{ amount, 0 };
-    updateTransform();
+    updateTransformInteractive();
 }
 
 void MediaWidget::translateRight(const float amount)
 {
     _currentTranslation += QPointF{ amount, 0 };
-    updateTransform();
+    updateTransformInteractive();
 }
 
 void MediaWidget::translateUp(const float amount)
 {
     _currentTranslation += QPointF{ 0, amount };
-    updateTransform();
+    updateTransformInteractive();
 }
 
 void MediaWidget::translateDown(const float amount)
 {
     _currentTranslation -= QPointF{ 0, amount };
-    updateTransform();
+    updateTransformInteractive();
 }
 
 void MediaWidget::resetTransform()
@@ -320,6 +394,20 @@ void MediaWidget::resetTransform()
     updateTransform();
 }
 
+void MediaWidget::toggleDisplayResolutionDecoding()
+{
+    _displayResolutionDecoding = !_displayResolutionDecoding;
+    _cachedMediaProxy.setDisplayDecodeSize(_displayResolutionDecoding ? size() * devicePixelRatio() : QSize());
+    _cachedMediaProxy.clear();
+    showMessage(
+        _displayResolutionDecoding ? "Display-resolution decoding enabled" : "Display-resolution decoding disabled");
+
+    if (_currentMediaType == CurrentMediaType::Image && std::filesystem::exists(_target))
+    {
+        setMedia(_target);
+    }
+}
+
 void MediaWidget::increaseVideoSpeed(const float amount) const
 {
     if (_currentMediaType == CurrentMediaType::Video && _videoPlayer)
@@ -345,6 +433,208 @@ void MediaWidget::increaseVideoVolume(const float amount) const
     }
 }
 
+MediaWidget::LoadedMedia MediaWidget::loadMedia(const std::string& source)
+{
+    LoadedMedia result;
+    result.source = source;
+    const MediaKind kind = classifyMedia(source);
+    if (kind == MediaKind::Video)
+    {
+        result.type = CurrentMediaType::Video;
+    }
+    else if (kind == MediaKind::Animation)
+    {
+        result.type = CurrentMediaType::Animation;
+        result.animation = _cachedMediaProxy.getAnimation(source);
+        if (!result.animation->isComplete())
+        {
+            result.decoder = openAnimationDecoder(source);
+        }
+    }
+    else if (kind == MediaKind::Image)
+    {
+        result.type = CurrentMediaType::Image;
+        result.image = _cachedMediaProxy.getImage(source);
+        result.hit = result.image.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        if (!result.hit)
+        {
+            // Stored thumbnails cost no I/O, embedded JPEG previews only a header read
+            result.placeholder = _thumbnailStore.find(source);
+            if (!result.placeholder)
+            {
+                result.placeholder = readEmbeddedPreview(source, 0);
+            }
+        }
+    }
+    return result;
+}
+
+void MediaWidget::showMedia(LoadedMedia& media)
+{
+    _target = media.source;
+    _refineTimer->stop();
+    _pendingImage = {};
+    _pendingTiles.clear();
+    _fullImageRequested = false;
+
+    if (_videoPlayer)
+    {
+        _videoPlayer->hide();
+        _videoPlayer->mediaPlayer()->stop();
+    }
+
+    _imageLabel->hide();
+    _animation.reset();
+
+    if (!media.type)
+    {
+        emit mediaChanged();
+        return;
+    }
+
+    _currentMediaType = *media.type;
+    switch (_currentMediaType)
+    {
+    case CurrentMediaType::Video:
+        if (!_videoPlayer)
+        {
+            initVideoPlayer();
+        }
+        _videoPlayer->setMedia(_target);
+        _videoPlayer->show();
+        emit mediaProbed(_target, MediaKind::Video, {});
+        break;
+    case CurrentMediaType::Animation:
+        _animation = std::make_unique<AnimationPlayer>(
+            media.animation, _cachedMediaProxy, _loadQueue, std::move(media.decoder));
+        _animation->setRenderBudget(_animationRenderBudget);
+        connectAnimationSignals();
+        _imageLabel->setPixmap({});
+        _animation->start();
+        std::printf("Frame count: %d\n", _animation->frameCount());
+        syncAnimationSize();
+        _imageLabel->show();
+        emit mediaProbed(_target, MediaKind::Animation, {});
+        break;
+    case CurrentMediaType::Image:
+        emit imageLookupResolved(media.hit);
+        if (!media.hit)
+        {
+            showPlaceholder(std::move(media.placeholder));
+        }
+        waitForImage(media.image);
+        _imageLabel->setMovie(nullptr);
+        updateTransform();
+        _imageLabel->show();
+        break;
+    }
+    emit mediaChanged();
+}
+
+void MediaWidget::loadFullImage()
+{
+    // The reduced image stays on screen until the full resolution one is ready
+    if (!_fullImageRequested)
+    {
+        _fullImageRequested = true;
+        waitForImage(_cachedMediaProxy.getFullImage(_target));
+    }
+}
+
+void MediaWidget::showPlaceholder(std::optional<QImage>&& placeholder)
+{
+    _image = placeholder ? std::make_shared<QImage>(std::move(*placeholder)) : nullptr;
+    _imageOriginalSize = {};
+    _preRendered.reset();
+    _pyramid.reset();
+    _tiled = false;
+    _isPlaceholder = true;
+    if (!_image)
+    {
+        _imageLabel->setPixmap({});
+    }
+}
+
+void MediaWidget::waitForImage(const std::shared_future<CachedImage>& future)
+{
+    if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        applyCachedImage(future.get());
+        return;
+    }
+
+    _pendingImage = future;
+}
+
+void MediaWidget::applyCachedImage(const CachedImage& cachedImage)
+{
+    _image = cachedImage.image();
+    _imageOriginalSize = cachedImage.originalSize();
+    emit mediaProbed(_target, MediaKind::Image, _imageOriginalSize);
+    _preRendered = cachedImage.rendered(currentRenderParameters());
+    _pyramid = cachedImage.pyramid();
+    _tiled = cachedImage.isTiled();
+    _isPlaceholder = false;
+}
+
+void MediaWidget::onImageDecoded()
+{
+    const auto isReady = [](const std::shared_future<CachedImage>& future) {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+
+    if (_pendingImage.valid() && isReady(_pendingImage))
+    {
+        const auto future = std::exchange(_pendingImage, {});
+        applyCachedImage(future.get());
+        if (_currentMediaType == CurrentMediaType::Image)
+        {
+            updateTransform();
+        }
+    }
+    else if (!_pendingTiles.empty() && std::ranges::all_of(_pendingTiles, isReady))
+    {
+        updateTransform();
+    }
+}
+
+std::optional<QImage> MediaWidget::renderVisibleTiles(const RenderParameters& parameters)
+{
+    const TileView view = tileViewFor(_imageOriginalSize, parameters);
+    if (view.tiles.empty())
+    {
+        return std::nullopt;
+    }
+
+    std::vector<std::pair<TileKey, std::shared_ptr<QImage>>> tiles;
+    for (const auto& tile : view.tiles)
+    {
+        auto future = _cachedMediaProxy.getTile(_target, tile);
+        if (future.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+        {
+            tiles.emplace_back(tile, future.get().image());
+        }
+        else
+        {
+            _pendingTiles.push_back(std::move(future));
+        }
+    }
+
+    if (!_pendingTiles.empty())
+    {
+        return std::nullopt;
+    }
+    return renderTiles(view, tiles);
+}
+
+RenderParameters MediaWidget::currentRenderParameters() const
+{
+    return { .viewportSize = size(),
+             .devicePixelRatio = devicePixelRatio(),
+             .zoom = _currentZoom,
+             .translation = _currentTranslation };
+}
+
 void MediaWidget::syncAnimationSize()
 {
     updateTransform();
@@ -352,12 +642,10 @@ void MediaWidget::syncAnimationSize()
 
 void MediaWidget::connectAnimationSignals()
 {
-    connect(_animation.get(), &QMovie::frameChanged, this, [this]([[maybe_unused]] int frame) {
-        _image = std::make_shared<QImage>(_animation->currentImage());
-        updateTransform();
+    // Frames arriving while the view is being zoomed or resized get the fast render too
+    connect(_animation.get(), &AnimationPlayer::frameChanged, this, [this]([[maybe_unused]] int frame) {
+        updateTransform(_refineTimer->isActive() ? RenderQuality::Fast : RenderQuality::Smooth);
     });
-
-    connect(_animation.get(), &QMovie::finished, _animation.get(), &QMovie::start);
 }
 
 void MediaWidget::initVideoPlayer()
@@ -371,4 +659,34 @@ void MediaWidget::initVideoPlayer()
     _videoPlayer->hide();
 
     _mainLayout->addWidget(_videoPlayer);
+}
+
+void MediaWidget::adjustCacheBudget()
+{
+    // Rendered pixmaps come on top of the decoded images, so they are part of what memory pressure shrinks
+    const size_t configuredBudget = _settings.cacheBudgetMB * 1024 * 1024;
+    const size_t configuredRenderBudget = configuredBudget / 4;
+    const size_t currentSize = _cachedMediaProxy.usage().currentSize + _renderCache.currentSize() +
+                               (_animation ? _animation->renderedBytes() : 0);
+    const size_t budget =
+        _memoryMonitor.recommendCacheBudget(configuredBudget + configuredRenderBudget, currentSize);
+
+    // Every tier gives memory back in the same proportion
+    const double share = configuredBudget == 0
+        ? 1.0
+        : static_cast<double>(budget) / static_cast<double>(configuredBudget + configuredRenderBudget);
+    const auto scaled = [share](const size_t bytes) {
+        return static_cast<size_t>(static_cast<double>(bytes) * share);
+    };
+
+    _cachedMediaProxy.setMaxCacheSize(scaled(configuredBudget));
+    _cachedMediaProxy.setMaxEncodedCacheSize(scaled(_settings.encodedCacheBudgetMB * 1024 * 1024));
+
+    // Still images and animations split the render share between them
+    _renderCache.setMaxSize(scaled(configuredRenderBudget / 2));
+    _animationRenderBudget = scaled(configuredRenderBudget - configuredRenderBudget / 2);
+    if (_animation)
+    {
+        _animation->setRenderBudget(_animationRenderBudget);
+    }
 }
\ No newline at end of file
@@ -2,7 +2,6 @@
 
 #include <QImage>
 #include <QLabel>
-#include <QMovie>
 #include <QStackedLayout>
 #include <QTimer>
 
@@ -10,8 +9,17 @@
 #include <QtMultimedia/QMediaPlayer>
 #include <QtMultimediaWidgets/QVideoWidget>
 
+#include <atomic>
+#include <optional>
+
+#include "AnimationPlayer.hpp"
 #include "CachedMediaProxy.hpp"
 #include "InfoOverlayWidget.hpp"
+#include "MemoryMonitor.hpp"
+#include "RenderCache.hpp"
+#include "StatsOverlayWidget.hpp"
+#include "ThumbnailStore.hpp"
+#include "Utils.hpp"
 #include "VideoPlayerWidget.hpp"
 
 enum class CurrentMediaType
@@ -30,19 +38,23 @@ public:
 
     void setMedia(const std::string& source);
 
-    std::variant<const QImage*, const QMovie*, const QMediaPlayer*> currentMediaSource() const;
+    std::variant<QSize, const AnimationPlayer*, const QMediaPlayer*> currentMediaSource() const;
     bool isInfoShown() const;
     void showMessage(const QString& message) const;
     void showInfo(const QString& info) const;
     void hideInfo() const;
     void toggleMute();
     void togglePlayPauseVideo() const;
-    void updateTransform();
+    void updateTransform(RenderQuality quality = RenderQuality::Smooth);
 
     void paintEvent(QPaintEvent* ev) override;
     void resizeEvent(QResizeEvent* ev) override;
 
     CachedMediaProxy& cachedMediaProxy();
+    ThumbnailStore& thumbnailStore();
+    void trimCache();
+    void toggleCacheStatistics() const;
+    std::string cacheStatistics();
 
     void zoomIn(float amount);
     void zoomOut(float amount);
@@ -51,12 +63,21 @@ public:
     void translateUp(float amount);
     void translateDown(float amount);
     void resetTransform();
+    void toggleDisplayResolutionDecoding();
 
     void increaseVideoSpeed(float amount) const;
     void increaseVideoVolume(float amount) const;
 
     CurrentMediaType currentMediaType() const { return _currentMediaType; }
 
+signals:
+    // The media requested by the latest setMedia() call is now shown
+    void mediaChanged();
+    // Whether the image requested by the latest setMedia() call was already decoded
+    void imageLookupResolved(bool hit);
+    // What showing the current media revealed about it, dimensions are invalid when not known
+    void mediaProbed(const std::string& path, MediaKind kind, QSize dimensions);
+
 private:
     std::string _target;
     bool _isVideo = false;
@@ -66,18 +87,69 @@ private:
 
     CurrentMediaType _currentMediaType = CurrentMediaType::Image;
 
+    Settings _settings;
+    MemoryMonitor _memoryMonitor;
+    QTimer* _memoryTimer = nullptr;
     CachedMediaProxy _cachedMediaProxy;
+    ThumbnailStore _thumbnailStore;
+    RenderCache _renderCache;
+    // The other half of the render share, the render cache holds the first
+    size_t _animationRenderBudget = 0;
     std::shared_ptr<QImage> _image;
-    std::shared_ptr<QMovie> _animation;
+    // Rendering of _image made by the decode thread, if any
+    std::shared_ptr<QImage> _preRendered;
+    std::shared_ptr<MipmapPyramid> _pyramid;
+    // Shown in place of _image's real content until the decode it stands in for completes
+    bool _isPlaceholder = false;
+    bool _fullImageRequested = false;
+    // Huge images show an overview, zoomed views are composed from tiles instead of a full resolution decode
+    bool _tiled = false;
+    std::shared_future<CachedImage> _pendingImage;
+    std::vector<std::shared_future<CachedImage>> _pendingTiles;
+    // Fires once zooming, panning or resizing has paused, to replace the fast render with a smooth one
+    QTimer* _refineTimer = nullptr;
+    QSize _imageOriginalSize;
+    bool _displayResolutionDecoding = false;
+    std::unique_ptr<AnimationPlayer> _animation;
+    // Bumped by every setMedia() call, background results carrying an older value are stale
+    std::atomic_uint64_t _mediaGeneration = 0;
 
     QLabel* _imageLabel = nullptr;
     VideoPlayerWidget* _videoPlayer = nullptr;
     InfoOverlayWidget* _infoOverlay = nullptr;
+    StatsOverlayWidget* _statsOverlay = nullptr;
 
     float _currentZoom = 1.0f;
     QPointF _currentTranslation = { 0.0f, 0.0f };
 
+    // Declared last so that a load still running is finished before the state it uses goes away
+    DecodeQueue _loadQueue;
+
+    void updateTransformInteractive();
+
+    // Everything setMedia() needs that may touch the file, gathered on _loadQueue
+    struct LoadedMedia
+    {
+        std::string source;
+        std::optional<CurrentMediaType> type;
+        std::shared_future<CachedImage> image;
+        bool hit = false;
+        std::optional<QImage> placeholder;
+        std::shared_ptr<CachedAnimation> animation;
+        std::unique_ptr<DecodeAheadDecoder> decoder;
+    };
+
+    LoadedMedia loadMedia(const std::string& source);
+    void showMedia(LoadedMedia& media);
+    void loadFullImage();
+    void showPlaceholder(std::optional<QImage>&& placeholder);
+    void waitForImage(const std::shared_future<CachedImage>& future);
+    void applyCachedImage(const CachedImage& cachedImage);
+    void onImageDecoded();
+    std::optional<QImage> renderVisibleTiles(const RenderParameters& parameters);
+    RenderParameters currentRenderParameters() const;
     void syncAnimationSize();
     void connectAnimationSignals();
     void initVideoPlayer();
+    void adjustCacheBudget();
 };
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "MemoryMonitor.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+constexpr size_t MIN_CACHE_BUDGET = 128ULL * 1024 * 1024;
+constexpr float HEADROOM_SHARE = 0.5f;
+constexpr float PRESSURE_THRESHOLD = 5.0f;
+constexpr float PRESSURE_FULL_SHRINK = 40.0f;
+
+namespace
+{
+    // procfs and cgroupfs report a size of zero, so these can't be read by size like regular files
+    std::optional<std::string> readSmallFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return std::nullopt;
+        }
+        std::stringstream sstr;
+        sstr << file.rdbuf();
+        return sstr.str();
+    }
+
+    std::optional<size_t> readByteCount(const std::string& path)
+    {
+        const auto text = readSmallFile(path);
+        if (!text)
+        {
+            return std::nullopt;
+        }
+
+        if (text->empty() || text->starts_with("max"))
+        {
+            return std::nullopt;
+        }
+
+        try
+        {
+            return std::stoull(*text);
+        }
+        catch ([[maybe_unused]] std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+
+    std::optional<size_t> readMemAvailable()
+    {
+        const auto text = readSmallFile("/proc/meminfo");
+        if (!text)
+        {
+            return std::nullopt;
+        }
+
+        std::istringstream lines(*text);
+        std::string key;
+        size_t valueKB = 0;
+        std::string unit;
+        while (lines >> key >> valueKB >> unit)
+        {
+            if (key == "MemAvailable:")
+            {
+                return valueKB * 1024;
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<float> readPressure(const std::string& path)
+    {
+        const auto text = readSmallFile(path);
+        if (!text)
+        {
+            return std::nullopt;
+        }
+
+        // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+        const auto pos = text->find("some avg10=");
+        if (pos == std::string::npos)
+        {
+            return std::nullopt;
+        }
+
+        try
+        {
+            return std::stof(text->substr(pos + std::string_view("some avg10=").size()));
+        }
+        catch ([[maybe_unused]] std::exception&)
+        {
+            return std::nullopt;
+        }
+    }
+}
+
+MemoryMonitor::MemoryMonitor()
+{
+    // cgroup v2 exposes a single "0::/path" entry
+    const auto text = readSmallFile("/proc/self/cgroup");
+    if (!text)
+    {
+        return;
+    }
+
+    std::istringstream lines(*text);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (line.starts_with("0::"))
+        {
+            const auto directory = "/sys/fs/cgroup" + line.substr(3);
+            if (std::filesystem::exists(directory + "/memory.current"))
+            {
+                _cgroupDirectory = directory;
+            }
+            break;
+        }
+    }
+}
+
+MemoryStatus MemoryMonitor::read() const
+{
+    MemoryStatus status;
+    status.availableBytes = readMemAvailable();
+
+    if (!_cgroupDirectory.empty())
+    {
+        status.cgroupUsageBytes = readByteCount(_cgroupDirectory + "/memory.current");
+
+        // The effective limit is the tightest one anywhere up the hierarchy
+        for (std::filesystem::path directory = _cgroupDirectory; directory.string().starts_with("/sys/fs/cgroup/");
+             directory = directory.parent_path())
+        {
+            if (const auto limit = readByteCount((directory / "memory.max").string()))
+            {
+                status.cgroupLimitBytes = std::min(status.cgroupLimitBytes.value_or(*limit), *limit);
+            }
+        }
+
+        status.pressure = readPressure(_cgroupDirectory + "/memory.pressure");
+    }
+
+    if (!status.pressure)
+    {
+        status.pressure = readPressure("/proc/pressure/memory");
+    }
+
+    return status;
+}
+
+size_t MemoryMonitor::recommendCacheBudget(const size_t configuredBudget, const size_t currentCacheSize) const
+{
+    const MemoryStatus status = read();
+
+    std::optional<size_t> headroom = status.availableBytes;
+    if (status.cgroupLimitBytes && status.cgroupUsageBytes)
+    {
+        const size_t cgroupHeadroom =
+            *status.cgroupLimitBytes > *status.cgroupUsageBytes ? *status.cgroupLimitBytes - *status.cgroupUsageBytes : 0;
+        headroom = std::min(headroom.value_or(cgroupHeadroom), cgroupHeadroom);
+    }
+
+    size_t budget = configuredBudget;
+    if (headroom)
+    {
+        // Memory the cache already holds is ours to keep, only part of what is still free may be claimed
+        budget = std::min(budget, currentCacheSize + static_cast<size_t>(static_cast<float>(*headroom) * HEADROOM_SHARE));
+    }
+
+    if (status.pressure && *status.pressure > PRESSURE_THRESHOLD)
+    {
+        const float shrink = std::clamp(
+            (*status.pressure - PRESSURE_THRESHOLD) / (PRESSURE_FULL_SHRINK - PRESSURE_THRESHOLD),
+            0.0f,
+            0.75f);
+        budget = static_cast<size_t>(static_cast<float>(budget) * (1.0f - shrink));
+    }
+
+    return std::max(budget, std::min(MIN_CACHE_BUDGET, configuredBudget));
+}
\ No newline at end of file
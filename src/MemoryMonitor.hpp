@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+struct MemoryStatus
+{
+    std::optional<size_t> availableBytes;
+    std::optional<size_t> cgroupLimitBytes;
+    std::optional<size_t> cgroupUsageBytes;
+    // Share of recent time (0-100) in which tasks stalled on memory, PSI "some avg10"
+    std::optional<float> pressure;
+};
+
+// Reads system and cgroup v2 memory state to size the media cache, everything is optional off Linux
+class MemoryMonitor
+{
+public:
+    MemoryMonitor();
+
+    MemoryStatus read() const;
+    size_t recommendCacheBudget(size_t configuredBudget, size_t currentCacheSize) const;
+
+private:
+    std::string _cgroupDirectory;
+};
\ No newline at end of file
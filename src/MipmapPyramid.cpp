@@ -0,0 +1,63 @@
+#include "MipmapPyramid.hpp"
+
+#include <cmath>
+
+#include "Resampler.hpp"
+
+// Levels below this size are never needed, the viewport is always larger
+constexpr int MIN_LEVEL_SIZE = 256;
+
+MipmapPyramid::MipmapPyramid(std::shared_ptr<QImage> base)
+    : _base(std::move(base))
+{
+}
+
+void MipmapPyramid::setGrowthCallback(GrowthCallback callback)
+{
+    std::lock_guard lock(_mutex);
+    _onGrowth = std::move(callback);
+}
+
+std::shared_ptr<QImage> MipmapPyramid::levelFor(const double scale)
+{
+    if (scale >= 0.5 || scale <= 0 || _base->isNull())
+    {
+        return _base;
+    }
+
+    const auto wanted = static_cast<size_t>(std::floor(std::log2(1.0 / scale)));
+    size_t added = 0;
+    GrowthCallback onGrowth;
+    std::shared_ptr<QImage> result;
+    {
+        std::lock_guard lock(_mutex);
+        while (_levels.size() < wanted)
+        {
+            const auto& previous = _levels.empty() ? *_base : *_levels.back();
+            if (std::min(previous.width(), previous.height()) / 2 < MIN_LEVEL_SIZE)
+            {
+                break;
+            }
+
+            auto level = std::make_shared<QImage>(resample(previous, previous.size() / 2, ResampleFilter::Area));
+            added += static_cast<size_t>(level->sizeInBytes());
+            _levels.push_back(std::move(level));
+        }
+
+        _memorySize += added;
+        onGrowth = _onGrowth;
+        result = _levels.empty() ? _base : _levels[std::min(wanted, _levels.size()) - 1];
+    }
+
+    if (added > 0 && onGrowth)
+    {
+        onGrowth(added);
+    }
+    return result;
+}
+
+size_t MipmapPyramid::getMemorySize() const
+{
+    std::lock_guard lock(_mutex);
+    return _memorySize;
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QImage>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Successively halved copies of an image, built on first use so zoomed views resample from a nearby level
+class MipmapPyramid
+{
+public:
+    using GrowthCallback = std::function<void(size_t bytes)>;
+
+    explicit MipmapPyramid(std::shared_ptr<QImage> base);
+    MipmapPyramid(const MipmapPyramid&) = delete;
+
+    void setGrowthCallback(GrowthCallback callback);
+    // Smallest level that is still at least `scale` times the base size
+    std::shared_ptr<QImage> levelFor(double scale);
+    size_t getMemorySize() const;
+
+private:
+    std::shared_ptr<QImage> _base;
+    std::vector<std::shared_ptr<QImage>> _levels;
+    size_t _memorySize = 0;
+    GrowthCallback _onGrowth;
+    mutable std::mutex _mutex;
+};
\ No newline at end of file
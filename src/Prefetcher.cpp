@@ -0,0 +1,188 @@
+#include "Prefetcher.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+constexpr size_t HISTORY_SIZE = 8;
+constexpr int64_t MAX_TRACKED_STRIDE = 50;
+constexpr auto IDLE_TIMEOUT = std::chrono::seconds(2);
+constexpr int64_t BASE_WINDOW = 3;
+constexpr int64_t MAX_WINDOW = 24;
+constexpr int64_t MAX_STRIDE_LOOKAHEAD = 4;
+
+bool Prefetcher::notifyNavigation(const int64_t index)
+{
+    if (!_history.empty() && _history.back().index == index)
+    {
+        return false;
+    }
+
+    // Home/End/random jumps say nothing about where the user is heading next
+    if (!_history.empty() && std::abs(index - _history.back().index) > MAX_TRACKED_STRIDE)
+    {
+        _history.clear();
+    }
+
+    _history.push_back({ .index = index, .time = Clock::now() });
+    if (_history.size() > HISTORY_SIZE)
+    {
+        _history.pop_front();
+    }
+    return true;
+}
+
+void Prefetcher::reset()
+{
+    _history.clear();
+}
+
+std::vector<PrefetchRequest> Prefetcher::plan(
+    const int64_t currentIndex,
+    const size_t fileCount,
+    const PrefetchBudget& budget) const
+{
+    const int dir = direction();
+    const int64_t step = stride();
+
+    // Look further ahead the faster the user moves and the longer each decode takes
+    const float decodeSeconds = std::chrono::duration<float>(budget.averageDecodeTime).count();
+    const auto lookahead = static_cast<int64_t>(std::ceil(stepRate() * decodeSeconds * 2.0f));
+    int64_t ahead = step > 1 ? BASE_WINDOW : BASE_WINDOW + lookahead;
+    int64_t behind = dir == 0 ? BASE_WINDOW : 1;
+
+    // Never plan more than the cache can hold, or the window would evict itself
+    if (budget.averageEntrySize > 0)
+    {
+        const auto affordable = static_cast<int64_t>(budget.maxCacheSize / budget.averageEntrySize) - 1;
+        ahead = std::min(ahead, std::max<int64_t>(1, affordable - behind));
+        behind = std::min(behind, std::max<int64_t>(0, affordable - ahead));
+    }
+    ahead = std::min(ahead, MAX_WINDOW);
+
+    std::vector<PrefetchRequest> result;
+    std::unordered_set<int64_t> planned;
+    const auto add = [&](const int64_t index, const DecodePriority priority) {
+        if (index >= 0 && index < static_cast<int64_t>(fileCount) && index != currentIndex && planned.insert(index).second)
+        {
+            result.push_back({ .index = index, .priority = priority });
+        }
+    };
+
+    const int forward = dir == 0 ? 1 : dir;
+    add(currentIndex + forward, DecodePriority::Next);
+    add(currentIndex - forward, DecodePriority::Previous);
+
+    // Paging users land `step` items away, so the pages themselves matter more than the items in between
+    if (step > 1)
+    {
+        const int64_t pages = std::min(1 + lookahead, MAX_STRIDE_LOOKAHEAD);
+        for (int64_t i = 1; i <= pages; ++i)
+        {
+            add(currentIndex + (forward * step * i), i == 1 ? DecodePriority::Next : DecodePriority::Far);
+        }
+    }
+
+    for (int64_t i = 2; i <= std::max(ahead, behind); ++i)
+    {
+        if (i <= ahead)
+        {
+            add(currentIndex + (forward * i), DecodePriority::Far);
+        }
+        if (i <= behind)
+        {
+            add(currentIndex - (forward * i), DecodePriority::Far);
+        }
+    }
+
+    return result;
+}
+
+std::vector<int64_t> Prefetcher::encodedPlan(const int64_t currentIndex, const size_t fileCount, const size_t count) const
+{
+    const int dir = direction();
+    const int forward = dir == 0 ? 1 : dir;
+
+    // File bytes are cheap next to decoded pixels, so the window reaches far ahead where the user is heading
+    const auto ahead = static_cast<int64_t>(dir == 0 ? count / 2 : count * 3 / 4);
+    const auto behind = static_cast<int64_t>(count) - ahead;
+
+    std::vector<int64_t> result;
+    const auto add = [&](const int64_t index) {
+        if (index >= 0 && index < static_cast<int64_t>(fileCount))
+        {
+            result.push_back(index);
+        }
+    };
+
+    for (int64_t i = 1; i <= std::max(ahead, behind); ++i)
+    {
+        if (i <= ahead)
+        {
+            add(currentIndex + (forward * i));
+        }
+        if (i <= behind)
+        {
+            add(currentIndex - (forward * i));
+        }
+    }
+    return result;
+}
+
+void Prefetcher::recordLookup(const bool hit)
+{
+    ++_lookups;
+    if (hit)
+    {
+        ++_hits;
+    }
+}
+
+float Prefetcher::hitRate() const
+{
+    return _lookups == 0 ? 0.0f : static_cast<float>(_hits) / static_cast<float>(_lookups);
+}
+
+int Prefetcher::direction() const
+{
+    if (_history.size() < 2 || Clock::now() - _history.back().time > IDLE_TIMEOUT)
+    {
+        return 0;
+    }
+
+    // Recent steps weigh more, so a single step back after a long forward run flips the direction quickly
+    float weightedSum = 0.0f;
+    float weight = 1.0f;
+    for (size_t i = _history.size() - 1; i > 0; --i)
+    {
+        const auto delta = _history[i].index - _history[i - 1].index;
+        weightedSum += weight * static_cast<float>(delta > 0 ? 1 : -1);
+        weight *= 0.5f;
+    }
+
+    if (std::abs(weightedSum) < 0.25f)
+    {
+        return 0;
+    }
+    return weightedSum > 0 ? 1 : -1;
+}
+
+int64_t Prefetcher::stride() const
+{
+    if (_history.size() < 2)
+    {
+        return 1;
+    }
+    return std::abs(_history.back().index - _history[_history.size() - 2].index);
+}
+
+float Prefetcher::stepRate() const
+{
+    if (_history.size() < 2 || Clock::now() - _history.back().time > IDLE_TIMEOUT)
+    {
+        return 0.0f;
+    }
+
+    const float seconds = std::chrono::duration<float>(_history.back().time - _history.front().time).count();
+    return seconds > 0.0f ? static_cast<float>(_history.size() - 1) / seconds : 0.0f;
+}
\ No newline at end of file
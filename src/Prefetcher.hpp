@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "DecodeQueue.hpp"
+
+struct PrefetchRequest
+{
+    int64_t index;
+    DecodePriority priority;
+};
+
+struct PrefetchBudget
+{
+    size_t maxCacheSize = 0;
+    size_t averageEntrySize = 0;
+    std::chrono::milliseconds averageDecodeTime = {};
+};
+
+// Picks which neighbours to decode ahead of time from the recent navigation direction, speed and step size
+class Prefetcher
+{
+public:
+    bool notifyNavigation(int64_t index);
+    void reset();
+
+    std::vector<PrefetchRequest> plan(int64_t currentIndex, size_t fileCount, const PrefetchBudget& budget) const;
+    std::vector<int64_t> encodedPlan(int64_t currentIndex, size_t fileCount, size_t count) const;
+
+    void recordLookup(bool hit);
+    float hitRate() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct NavigationEvent
+    {
+        int64_t index;
+        Clock::time_point time;
+    };
+
+    std::deque<NavigationEvent> _history;
+    size_t _lookups = 0;
+    size_t _hits = 0;
+
+    int direction() const;
+    int64_t stride() const;
+    float stepRate() const;
+};
\ No newline at end of file
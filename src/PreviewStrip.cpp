@@ -12,9 +12,9 @@ constexpr auto LABEL_STYLESHEET = R"(
     }
 )";
 
-PreviewStrip::PreviewStrip(CachedMediaProxy& cachedMediaProxy, QWidget* parent)
+PreviewStrip::PreviewStrip(ThumbnailStore& thumbnailStore, QWidget* parent)
     : QWidget(parent)
-    , _cachedMediaProxy(cachedMediaProxy)
+    , _thumbnailStore(thumbnailStore)
 {
     setAttribute(Qt::WidgetAttribute::WA_TransparentForMouseEvents);
     setFocusPolicy(Qt::FocusPolicy::NoFocus);
@@ -29,7 +29,7 @@ PreviewStrip::PreviewStrip(CachedMediaProxy& cachedMediaProxy, QWidget* parent)
         label->setText("NO-MEDIA");
         label->setStyleSheet(LABEL_STYLESHEET);
         label->setFont(getTextFont());
-        label->setFixedSize(116, 116);
+        label->setFixedSize(ThumbnailStore::THUMBNAIL_SIZE, ThumbnailStore::THUMBNAIL_SIZE);
         label->setAlignment(Qt::AlignmentFlag::AlignCenter);
 
         _labels.emplace_back(label);
@@ -38,6 +38,10 @@ PreviewStrip::PreviewStrip(CachedMediaProxy& cachedMediaProxy, QWidget* parent)
     _layout->addStretch(1);
 
     _timer = new QTimer(this);
+    _timer->setInterval(100);
+    _timer->setSingleShot(false);
+    connect(_timer, &QTimer::timeout, this, [this] { updateLabels(); });
+
     _movies = { 5, nullptr };
 
     setLayout(_layout);
@@ -48,6 +52,7 @@ void PreviewStrip::loadImages(const std::vector<std::string>& paths)
     assert(paths.size() <= _labels.size());
 
     _paths = paths;
+    _thumbnailStore.cancelPendingExcept(paths);
 
     for (auto* movie : _movies)
     {
@@ -57,84 +62,80 @@ void PreviewStrip::loadImages(const std::vector<std::string>& paths)
         }
     }
 
-    _timer->setInterval(100);
-    _timer->setSingleShot(false);
-
     _completed = std::vector<bool>(paths.size(), false);
+    _timer->start();
+}
 
-    connect(_timer, &QTimer::timeout, this, [this]() {
-        for (size_t i = 0; i < _paths.size(); ++i)
+void PreviewStrip::updateLabels()
+{
+    for (size_t i = 0; i < _paths.size(); ++i)
+    {
+        if (_completed[i])
         {
-            if (_completed[i])
-            {
-                continue;
-            }
+            continue;
+        }
 
-            const auto& path = _paths[i];
+        const auto& path = _paths[i];
+        const MediaKind kind = path.empty() ? MediaKind::None : classifyMedia(path);
 
-            if (path.empty())
+        if (path.empty())
+        {
+            _labels[i]->setScaledContents(false);
+            _labels[i]->clear();
+            _labels[i]->setText("NO-MEDIA");
+            _completed[i] = true;
+        }
+        else if (kind != MediaKind::Image && kind != MediaKind::Animation)
+        {
+            _labels[i]->setScaledContents(false);
+            _labels[i]->clear();
+            _labels[i]->setText("VIDEO");
+            _completed[i] = true;
+        }
+        else if (kind == MediaKind::Image)
+        {
+            _labels[i]->setScaledContents(false);
+            if (const auto thumbnail = _thumbnailStore.find(path))
             {
-                _labels[i]->setScaledContents(false);
                 _labels[i]->clear();
-                _labels[i]->setText("NO-MEDIA");
+                _labels[i]->setPixmap(QPixmap::fromImage(*thumbnail));
+                _labels[i]->update();
                 _completed[i] = true;
             }
-            else if (!isImage(path) && !isAnimation(path))
+            else if (_thumbnailStore.isUndecodable(path))
             {
-                _labels[i]->setScaledContents(false);
                 _labels[i]->clear();
-                _labels[i]->setText("VIDEO");
+                _labels[i]->setText("ERROR");
                 _completed[i] = true;
             }
-            else if (isImage(path))
-            {
-                _labels[i]->setScaledContents(false);
-                auto future = _cachedMediaProxy.getImage(path);
-                if (future.wait_for(std::chrono::milliseconds(0)) == std::future_status::ready)
-                {
-                    auto& result = future.get();
-                    _labels[i]->clear();
-                    _labels[i]->setPixmap(
-                        QPixmap::fromImage(*result.image())
-                            .scaled(
-                                _labels[i]->size(),
-                                Qt::AspectRatioMode::KeepAspectRatio,
-                                Qt::TransformationMode::SmoothTransformation));
-                    _labels[i]->update();
-                    _completed[i] = true;
-                }
-                else
-                {
-                    _labels[i]->setScaledContents(false);
-                    _labels[i]->clear();
-                    _labels[i]->setText("LOADING...");
-                }
-            }
-            else if (isAnimation(path))
+            else
             {
-                auto anim = CachedMediaProxy::getAnimation(path);
-                if (_movies[i])
-                {
-                    _movies[i]->stop();
-                    delete _movies[i];
-                }
-                _movies[i] = new QMovie(QString::fromStdString(path));
-                _movies[i]->setScaledSize(_labels[i]->size());
-                _movies[i]->setCacheMode(QMovie::CacheMode::CacheNone);
-                _movies[i]->start();
-
+                _thumbnailStore.generate(path);
                 _labels[i]->clear();
-                _labels[i]->setMovie(_movies[i]);
-                _labels[i]->setScaledContents(true);
-
-                _completed[i] = true;
+                _labels[i]->setText("LOADING...");
             }
         }
-        if (std::ranges::all_of(_completed, [](const bool v) { return v; }))
+        else if (kind == MediaKind::Animation)
         {
-            _timer->stop();
-        }
-    });
+            if (_movies[i])
+            {
+                _movies[i]->stop();
+                delete _movies[i];
+            }
+            _movies[i] = new QMovie(QString::fromStdString(path));
+            _movies[i]->setScaledSize(_labels[i]->size());
+            _movies[i]->setCacheMode(QMovie::CacheMode::CacheNone);
+            _movies[i]->start();
 
-    _timer->start();
+            _labels[i]->clear();
+            _labels[i]->setMovie(_movies[i]);
+            _labels[i]->setScaledContents(true);
+
+            _completed[i] = true;
+        }
+    }
+    if (std::ranges::all_of(_completed, [](const bool v) { return v; }))
+    {
+        _timer->stop();
+    }
 }
\ No newline at end of file
@@ -2,24 +2,27 @@
 
 #include <QHBoxLayout>
 #include <QLabel>
+#include <QMovie>
 #include <QTimer>
 #include <QWidget>
 
-#include "CachedMediaProxy.hpp"
+#include "ThumbnailStore.hpp"
 
 class PreviewStrip : public QWidget
 {
 public:
-    PreviewStrip(CachedMediaProxy& cachedMediaProxy, QWidget* parent);
+    PreviewStrip(ThumbnailStore& thumbnailStore, QWidget* parent);
 
     void loadImages(const std::vector<std::string>& paths);
 
 private:
-    CachedMediaProxy& _cachedMediaProxy;
+    ThumbnailStore& _thumbnailStore;
     QHBoxLayout* _layout = nullptr;
     std::vector<QLabel*> _labels;
     std::vector<QMovie*> _movies;
     std::vector<bool> _completed;
     std::vector<std::string> _paths;
     QTimer* _timer = nullptr;
+
+    void updateLabels();
 };
\ No newline at end of file
@@ -0,0 +1,138 @@
+#include "RenderCache.hpp"
+
+#include <QPainter>
+
+#include <ien/math_utils.hpp>
+
+#include <algorithm>
+#include <format>
+
+#include "Resampler.hpp"
+
+QRect renderSourceRect(const QSize imageSize, const RenderParameters& parameters)
+{
+    const auto sourceRectSize =
+        parameters.viewportSize.scaled(imageSize, Qt::KeepAspectRatioByExpanding) / parameters.zoom;
+    const auto diff = imageSize - sourceRectSize;
+
+    const float half_width = static_cast<float>(diff.width()) / 2;
+    const float half_height = static_cast<float>(diff.height()) / 2;
+
+    const auto translation = parameters.translation;
+    const float translateX = ien::remap(static_cast<float>(translation.x()), -1, 1, -half_width, half_width);
+    const float translateY = ien::remap(static_cast<float>(translation.y()), -1, 1, -half_height, half_height);
+
+    return {
+        static_cast<int>(half_width + translateX),
+        static_cast<int>(half_height + translateY),
+        sourceRectSize.width(),
+        sourceRectSize.height()
+    };
+}
+
+QImage renderImage(const QImage& image, const RenderParameters& parameters, const RenderQuality quality)
+{
+    const QRect sourceRect = renderSourceRect(image.size(), parameters);
+    const QSize targetSize =
+        sourceRect.size().scaled(parameters.viewportSize * parameters.devicePixelRatio, Qt::KeepAspectRatio);
+
+    if (quality == RenderQuality::Fast)
+    {
+        // Samples the source in place, without copying the visible area out first
+        QImage result(targetSize, image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+        result.fill(Qt::transparent);
+        QPainter painter(&result);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        painter.drawImage(QRect(QPoint(0, 0), targetSize), image, sourceRect);
+        return result;
+    }
+
+    return resample(image.copy(sourceRect), targetSize);
+}
+
+double renderScale(const QSize imageSize, const RenderParameters& parameters)
+{
+    const auto sourceRectSize =
+        parameters.viewportSize.scaled(imageSize, Qt::KeepAspectRatioByExpanding) / parameters.zoom;
+    const QSize targetSize = sourceRectSize.scaled(parameters.viewportSize * parameters.devicePixelRatio, Qt::KeepAspectRatio);
+    return sourceRectSize.width() == 0 ? 1.0 : static_cast<double>(targetSize.width()) / sourceRectSize.width();
+}
+
+RenderCache::RenderCache(const size_t maxBytes)
+    : _maxSize(maxBytes)
+{
+}
+
+std::optional<QPixmap> RenderCache::find(const qint64 imageKey, const RenderParameters& parameters)
+{
+    const auto it = _pixmaps.find(makeKey(imageKey, parameters));
+    if (it == _pixmaps.end())
+    {
+        return std::nullopt;
+    }
+
+    _lru.splice(_lru.begin(), _lru, it->second.lruIterator);
+    return it->second.pixmap;
+}
+
+void RenderCache::insert(const qint64 imageKey, const RenderParameters& parameters, const QPixmap& pixmap)
+{
+    const size_t size = pixmapBytes(pixmap);
+    if (size > _maxSize)
+    {
+        return;
+    }
+
+    auto key = makeKey(imageKey, parameters);
+    if (_pixmaps.contains(key))
+    {
+        return;
+    }
+
+    evictUntilFits(size);
+    _lru.push_front(key);
+    _pixmaps.emplace(std::move(key), Entry{ .pixmap = pixmap, .lruIterator = _lru.begin() });
+    _currentSize += size;
+}
+
+void RenderCache::setMaxSize(const size_t bytes)
+{
+    _maxSize = bytes;
+    evictUntilFits(0);
+}
+
+void RenderCache::clear()
+{
+    _pixmaps.clear();
+    _lru.clear();
+    _currentSize = 0;
+}
+
+std::string RenderCache::makeKey(const qint64 imageKey, const RenderParameters& parameters)
+{
+    return std::format(
+        "{}:{}x{}@{}:{}:{},{}",
+        imageKey,
+        parameters.viewportSize.width(),
+        parameters.viewportSize.height(),
+        parameters.devicePixelRatio,
+        parameters.zoom,
+        parameters.translation.x(),
+        parameters.translation.y());
+}
+
+size_t RenderCache::pixmapBytes(const QPixmap& pixmap)
+{
+    return static_cast<size_t>(pixmap.width()) * pixmap.height() * std::max(pixmap.depth() / 8, 1);
+}
+
+void RenderCache::evictUntilFits(const size_t incomingSize)
+{
+    while (!_lru.empty() && _currentSize + incomingSize > _maxSize)
+    {
+        const auto it = _pixmaps.find(_lru.back());
+        _currentSize -= pixmapBytes(it->second.pixmap);
+        _pixmaps.erase(it);
+        _lru.pop_back();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <QImage>
+#include <QPixmap>
+#include <QPointF>
+#include <QRect>
+#include <QSize>
+
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+struct RenderParameters
+{
+    QSize viewportSize;
+    qreal devicePixelRatio = 1.0;
+    float zoom = 1.0f;
+    QPointF translation = { 0.0f, 0.0f };
+
+    bool operator==(const RenderParameters&) const = default;
+};
+
+enum class RenderQuality
+{
+    // Bilinear sampling straight from the source, for frames shown while the user is still zooming or resizing
+    Fast,
+    Smooth
+};
+
+// Part of an image of the given size that is visible with the given parameters
+QRect renderSourceRect(QSize imageSize, const RenderParameters& parameters);
+// Crops and scales an image the way MediaWidget shows it, safe to call from any thread
+QImage renderImage(
+    const QImage& image,
+    const RenderParameters& parameters,
+    RenderQuality quality = RenderQuality::Smooth);
+// Ratio between output pixels and source pixels when rendering an image of the given size
+double renderScale(QSize imageSize, const RenderParameters& parameters);
+
+// Display-ready pixmaps of recently shown views, owned by the GUI thread
+class RenderCache
+{
+public:
+    explicit RenderCache(size_t maxBytes);
+
+    std::optional<QPixmap> find(qint64 imageKey, const RenderParameters& parameters);
+    void insert(qint64 imageKey, const RenderParameters& parameters, const QPixmap& pixmap);
+    void setMaxSize(size_t bytes);
+    size_t currentSize() const { return _currentSize; }
+    void clear();
+
+private:
+    struct Entry
+    {
+        QPixmap pixmap;
+        std::list<std::string>::iterator lruIterator;
+    };
+
+    size_t _maxSize;
+    size_t _currentSize = 0;
+    std::unordered_map<std::string, Entry> _pixmaps;
+    // Most recently used first
+    std::list<std::string> _lru;
+
+    static std::string makeKey(qint64 imageKey, const RenderParameters& parameters);
+    static size_t pixmapBytes(const QPixmap& pixmap);
+    void evictUntilFits(size_t incomingSize);
+};
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "Resampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numbers>
+#include <thread>
+#include <vector>
+
+#include "DecodeQueue.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define IGAL_QT_X86_SIMD
+    #include <immintrin.h>
+#endif
+
+namespace
+{
+    constexpr double LANCZOS_RADIUS = 3.0;
+    // Below this many output pixels per thread, starting threads costs more than it saves
+    constexpr size_t MIN_PIXELS_PER_THREAD = 128 * 1024;
+    constexpr int CHANNELS = 4;
+    // 32-bit pixel formats keep alpha in the most significant byte, which is the last one in memory here
+    constexpr int ALPHA_CHANNEL = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? 3 : 0;
+
+    // Source taps and their weights for every output pixel along one axis
+    struct Contributions
+    {
+        std::vector<int> first;
+        std::vector<int> count;
+        std::vector<float> weights;
+        int maxTaps = 0;
+
+        const float* weightsFor(const int index) const { return weights.data() + (static_cast<size_t>(index) * maxTaps); }
+    };
+
+    double sinc(double x)
+    {
+        if (x == 0.0)
+        {
+            return 1.0;
+        }
+        x *= std::numbers::pi;
+        return std::sin(x) / x;
+    }
+
+    double lanczos(const double x)
+    {
+        return std::abs(x) < LANCZOS_RADIUS ? sinc(x) * sinc(x / LANCZOS_RADIUS) : 0.0;
+    }
+
+    Contributions computeContributions(const int sourceSize, const int targetSize, const ResampleFilter filter)
+    {
+        const double scale = static_cast<double>(targetSize) / sourceSize;
+        // Downscaling widens the filter so every source pixel contributes
+        const double stretch = std::max(1.0, 1.0 / scale);
+        const double support = filter == ResampleFilter::Lanczos3 ? LANCZOS_RADIUS * stretch : 0.5 * stretch;
+
+        Contributions result;
+        result.maxTaps = static_cast<int>(std::ceil(support * 2.0)) + 2;
+        result.first.resize(targetSize);
+        result.count.resize(targetSize);
+        result.weights.assign(static_cast<size_t>(targetSize) * result.maxTaps, 0.0f);
+
+        std::vector<double> weights(result.maxTaps);
+        for (int i = 0; i < targetSize; ++i)
+        {
+            const double center = (i + 0.5) / scale;
+            const int begin = std::max(0, static_cast<int>(std::floor(center - support)));
+            const int end = std::min(sourceSize, static_cast<int>(std::ceil(center + support)));
+
+            int taps = 0;
+            double total = 0.0;
+            for (int j = begin; j < end && taps < result.maxTaps; ++j, ++taps)
+            {
+                const double weight = filter == ResampleFilter::Lanczos3
+                    ? lanczos((j + 0.5 - center) / stretch)
+                    : std::max(0.0, std::min(j + 1.0, center + support) - std::max(static_cast<double>(j), center - support));
+                weights[taps] = weight;
+                total += weight;
+            }
+
+            float* target = result.weights.data() + (static_cast<size_t>(i) * result.maxTaps);
+            if (taps == 0 || total == 0.0)
+            {
+                // Can only happen at the very edge, falls back to the nearest pixel
+                result.first[i] = std::clamp(static_cast<int>(center), 0, sourceSize - 1);
+                result.count[i] = 1;
+                target[0] = 1.0f;
+                continue;
+            }
+
+            result.first[i] = begin;
+            result.count[i] = taps;
+            for (int k = 0; k < taps; ++k)
+            {
+                target[k] = static_cast<float>(weights[k] / total);
+            }
+        }
+        return result;
+    }
+
+    // Filters one row of 8-bit pixels horizontally into floats
+    void horizontalScalar(const uint8_t* source, float* target, const Contributions& contributions, const int width)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const uint8_t* pixels = source + (static_cast<size_t>(contributions.first[x]) * CHANNELS);
+            const float* weights = contributions.weightsFor(x);
+            float sum[CHANNELS] = {};
+            for (int k = 0; k < contributions.count[x]; ++k)
+            {
+                for (int c = 0; c < CHANNELS; ++c)
+                {
+                    sum[c] += weights[k] * pixels[(k * CHANNELS) + c];
+                }
+            }
+            std::memcpy(target + (static_cast<size_t>(x) * CHANNELS), sum, sizeof(sum));
+        }
+    }
+
+    // target += weight * source, over `count` floats
+    void accumulateScalar(float* target, const float* source, const float weight, const size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            target[i] += weight * source[i];
+        }
+    }
+
+    // Rounds filtered floats back to 8-bit, clamping colour to alpha so ringing can't break premultiplication
+    void storeScalar(const float* source, uint8_t* target, const int width)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const float* pixel = source + (static_cast<size_t>(x) * CHANNELS);
+            const float alpha = std::clamp(pixel[ALPHA_CHANNEL], 0.0f, 255.0f);
+            for (int c = 0; c < CHANNELS; ++c)
+            {
+                const float value = std::clamp(pixel[c], 0.0f, alpha);
+                target[(x * CHANNELS) + c] = static_cast<uint8_t>(std::lround(value));
+            }
+        }
+    }
+
+#ifdef IGAL_QT_X86_SIMD
+    __attribute__((target("sse4.1"))) __m128 loadPixelSse41(const uint8_t* pixel)
+    {
+        int32_t packed = 0;
+        std::memcpy(&packed, pixel, sizeof(packed));
+        return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+    }
+
+    __attribute__((target("sse4.1")))
+    void horizontalSse41(const uint8_t* source, float* target, const Contributions& contributions, const int width)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const uint8_t* pixels = source + (static_cast<size_t>(contributions.first[x]) * CHANNELS);
+            const float* weights = contributions.weightsFor(x);
+            __m128 sum = _mm_setzero_ps();
+            for (int k = 0; k < contributions.count[x]; ++k)
+            {
+                sum = _mm_add_ps(sum, _mm_mul_ps(loadPixelSse41(pixels + (k * CHANNELS)), _mm_set1_ps(weights[k])));
+            }
+            _mm_storeu_ps(target + (static_cast<size_t>(x) * CHANNELS), sum);
+        }
+    }
+
+    __attribute__((target("sse4.1")))
+    void accumulateSse41(float* target, const float* source, const float weight, const size_t count)
+    {
+        const __m128 w = _mm_set1_ps(weight);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_ps(target + i, _mm_add_ps(_mm_loadu_ps(target + i), _mm_mul_ps(_mm_loadu_ps(source + i), w)));
+        }
+        accumulateScalar(target + i, source + i, weight, count - i);
+    }
+
+    __attribute__((target("sse4.1"))) void storeSse41(const float* source, uint8_t* target, const int width)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 max = _mm_set1_ps(255.0f);
+        for (int x = 0; x < width; ++x)
+        {
+            __m128 pixel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + (static_cast<size_t>(x) * CHANNELS)), zero), max);
+            pixel = _mm_min_ps(pixel, _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 3, 3, 3)));
+            const __m128i words = _mm_packus_epi32(_mm_cvtps_epi32(pixel), _mm_setzero_si128());
+            const int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            std::memcpy(target + (x * CHANNELS), &packed, sizeof(packed));
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    void horizontalAvx2(const uint8_t* source, float* target, const Contributions& contributions, const int width)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const uint8_t* pixels = source + (static_cast<size_t>(contributions.first[x]) * CHANNELS);
+            const float* weights = contributions.weightsFor(x);
+            const int count = contributions.count[x];
+
+            // Two taps per iteration, one pixel in each 128-bit lane
+            __m256 sum = _mm256_setzero_ps();
+            int k = 0;
+            for (; k + 1 < count; k += 2)
+            {
+                const __m128i pair = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixels + (k * CHANNELS)));
+                const __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(pair));
+                const __m256 w = _mm256_setr_m128(_mm_set1_ps(weights[k]), _mm_set1_ps(weights[k + 1]));
+                sum = _mm256_fmadd_ps(values, w, sum);
+            }
+
+            __m128 total = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+            if (k < count)
+            {
+                total = _mm_fmadd_ps(loadPixelSse41(pixels + (k * CHANNELS)), _mm_set1_ps(weights[k]), total);
+            }
+            _mm_storeu_ps(target + (static_cast<size_t>(x) * CHANNELS), total);
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    void accumulateAvx2(float* target, const float* source, const float weight, const size_t count)
+    {
+        const __m256 w = _mm256_set1_ps(weight);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(target + i, _mm256_fmadd_ps(_mm256_loadu_ps(source + i), w, _mm256_loadu_ps(target + i)));
+        }
+        accumulateScalar(target + i, source + i, weight, count - i);
+    }
+#endif
+
+    struct Kernels
+    {
+        void (*horizontal)(const uint8_t*, float*, const Contributions&, int) = horizontalScalar;
+        void (*accumulate)(float*, const float*, float, size_t) = accumulateScalar;
+        void (*store)(const float*, uint8_t*, int) = storeScalar;
+    };
+
+    const Kernels& kernels()
+    {
+        static const Kernels selected = [] {
+            Kernels result;
+#ifdef IGAL_QT_X86_SIMD
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("sse4.1"))
+            {
+                result = { .horizontal = horizontalSse41, .accumulate = accumulateSse41, .store = storeSse41 };
+            }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            {
+                result.horizontal = horizontalAvx2;
+                result.accumulate = accumulateAvx2;
+            }
+#endif
+            return result;
+        }();
+        return selected;
+    }
+
+    // Resamples output rows [begin, end). Horizontally filtered source rows go through a ring just deep enough for
+    // one output row's taps, which works because the first tap never moves backwards as the output row advances.
+    void resampleRows(
+        const uint8_t* source,
+        const size_t sourceStride,
+        uint8_t* target,
+        const int targetWidth,
+        const size_t targetStride,
+        const Contributions& horizontal,
+        const Contributions& vertical,
+        const int begin,
+        const int end)
+    {
+        if (begin == end)
+        {
+            return;
+        }
+
+        const auto& kernel = kernels();
+        const size_t rowFloats = static_cast<size_t>(targetWidth) * CHANNELS;
+        const int ringRows = vertical.maxTaps;
+        std::vector<float> ring(static_cast<size_t>(ringRows) * rowFloats);
+        std::vector<float> sum(rowFloats);
+        const auto ringRow = [&](const int row) { return ring.data() + (static_cast<size_t>(row % ringRows) * rowFloats); };
+
+        int nextRow = vertical.first[begin];
+        for (int y = begin; y < end; ++y)
+        {
+            const int first = vertical.first[y];
+            const int last = first + vertical.count[y];
+            for (nextRow = std::max(nextRow, first); nextRow < last; ++nextRow)
+            {
+                kernel.horizontal(
+                    source + (static_cast<size_t>(nextRow) * sourceStride), ringRow(nextRow), horizontal, targetWidth);
+            }
+
+            std::ranges::fill(sum, 0.0f);
+            const float* weights = vertical.weightsFor(y);
+            for (int k = 0; k < vertical.count[y]; ++k)
+            {
+                kernel.accumulate(sum.data(), ringRow(first + k), weights[k], rowFloats);
+            }
+            kernel.store(sum.data(), target + (static_cast<size_t>(y) * targetStride), targetWidth);
+        }
+    }
+
+    void resampleBuffer(
+        const uint8_t* source,
+        const int sourceWidth,
+        const int sourceHeight,
+        const size_t sourceStride,
+        uint8_t* target,
+        const int targetWidth,
+        const int targetHeight,
+        const size_t targetStride,
+        const ResampleFilter filter)
+    {
+        const auto horizontal = computeContributions(sourceWidth, targetWidth, filter);
+        const auto vertical = computeContributions(sourceHeight, targetHeight, filter);
+
+        // Decode workers already run side by side, splitting their resamples too would only oversubscribe the CPU
+        const size_t totalPixels = static_cast<size_t>(targetWidth) * targetHeight;
+        const int bandCount = DecodeQueue::isWorkerThread()
+            ? 1
+            : static_cast<int>(std::clamp<size_t>(
+                  totalPixels / MIN_PIXELS_PER_THREAD,
+                  1,
+                  std::max(1U, std::thread::hardware_concurrency())));
+
+        // Each band refilters the few source rows it shares with its neighbour rather than synchronizing on them
+#pragma omp parallel for schedule(static) num_threads(bandCount) if (bandCount > 1)
+        for (int band = 0; band < bandCount; ++band)
+        {
+            resampleRows(
+                source,
+                sourceStride,
+                target,
+                targetWidth,
+                targetStride,
+                horizontal,
+                vertical,
+                targetHeight * band / bandCount,
+                targetHeight * (band + 1) / bandCount);
+        }
+    }
+}
+
+QImage resample(const QImage& image, const QSize targetSize, const ResampleFilter filter)
+{
+    if (image.isNull() || targetSize.isEmpty())
+    {
+        return {};
+    }
+
+    const QImage source =
+        image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    QImage result(targetSize, source.format());
+    if (result.isNull())
+    {
+        return {};
+    }
+
+    // bits() detaches, so it is taken once here rather than per row from the worker threads
+    resampleBuffer(
+        source.constBits(),
+        source.width(),
+        source.height(),
+        static_cast<size_t>(source.bytesPerLine()),
+        result.bits(),
+        result.width(),
+        result.height(),
+        static_cast<size_t>(result.bytesPerLine()),
+        filter);
+
+    return image.format() == QImage::Format_RGB888 ? result.convertToFormat(QImage::Format_RGB888) : result;
+}
\ No newline at end of file
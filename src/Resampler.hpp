@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QImage>
+#include <QSize>
+
+enum class ResampleFilter
+{
+    // Exact pixel-coverage averaging, the right choice for integer downscales
+    Area,
+    Lanczos3
+};
+
+// Multi-threaded separable resampler using SSE4.1 or AVX2 kernels when the CPU has them, working in row bands so
+// that only a few filtered rows per thread are held at once.
+// Images with alpha are filtered premultiplied; RGB888 input comes back as RGB888, anything else as
+// ARGB32_Premultiplied or RGB32.
+QImage resample(const QImage& image, QSize targetSize, ResampleFilter filter = ResampleFilter::Lanczos3);
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "StatsOverlayWidget.hpp"
+
+#include "Utils.hpp"
+
+StatsOverlayWidget::StatsOverlayWidget(std::function<std::string()> provider, QWidget* parent)
+    : QWidget(parent)
+    , _provider(std::move(provider))
+{
+    setFocusPolicy(Qt::FocusPolicy::NoFocus);
+    setAttribute(Qt::WidgetAttribute::WA_TransparentForMouseEvents);
+    setStyleSheet("QWidget{background-color:rgba(0, 0, 0, 0);}");
+
+    _layout = new QVBoxLayout(this);
+    _stats_label = new QLabel(this);
+    _layout->addWidget(_stats_label, 0, Qt::AlignmentFlag::AlignTop | Qt::AlignmentFlag::AlignRight);
+    _layout->addStretch(1);
+
+    _stats_label->setFont(getTextFont());
+    _stats_label->setStyleSheet(
+        "QWidget{background-color:rgba(80, 40, 0, 150); color:#ccffaa; padding:0.5em; "
+        "margin:0px; outline-style:solid; outline-color:#000000; outline-width:1px;}");
+    _stats_label->setFocusPolicy(Qt::FocusPolicy::NoFocus);
+    _stats_label->setAttribute(Qt::WidgetAttribute::WA_TransparentForMouseEvents);
+    _stats_label->setTextFormat(Qt::TextFormat::PlainText);
+    _stats_label->setWordWrap(false);
+
+    _refresh_timer = new QTimer(this);
+    _refresh_timer->setInterval(500);
+    connect(_refresh_timer, &QTimer::timeout, this, [this] { refresh(); });
+
+    hide();
+
+    disableFocusOnChildWidgets(this);
+}
+
+void StatsOverlayWidget::toggle()
+{
+    if (isVisible())
+    {
+        _refresh_timer->stop();
+        hide();
+    }
+    else
+    {
+        refresh();
+        show();
+        raise();
+        _refresh_timer->start();
+    }
+}
+
+void StatsOverlayWidget::refresh() const
+{
+    _stats_label->setText(QString::fromStdString(_provider()));
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QLabel>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QWidget>
+
+#include <functional>
+#include <string>
+
+class StatsOverlayWidget : public QWidget
+{
+public:
+    StatsOverlayWidget(std::function<std::string()> provider, QWidget* parent = nullptr);
+
+    void toggle();
+
+private:
+    std::function<std::string()> _provider;
+    QVBoxLayout* _layout;
+    QLabel* _stats_label;
+    QTimer* _refresh_timer;
+
+    void refresh() const;
+};
\ No newline at end of file
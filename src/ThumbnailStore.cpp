@@ -0,0 +1,344 @@
+#include "ThumbnailStore.hpp"
+
+#include <QDebug>
+#include <QImageReader>
+
+#include <ien/fs_utils.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+
+#include "DirectoryScanner.hpp"
+#include "EmbeddedPreview.hpp"
+#include "Resampler.hpp"
+#include "Utils.hpp"
+
+#ifdef __linux__
+    #include <sys/file.h>
+#endif
+
+constexpr uint64_t PACK_MAGIC = 0x314D485454514749; // "IGQTTHM1"
+constexpr size_t PACK_HEADER_SIZE = 4096;
+constexpr size_t PACK_SLOT_COUNT = 2048;
+constexpr size_t FALLBACK_SLOT_COUNT = 64;
+constexpr size_t THUMBNAIL_BYTES = ThumbnailStore::THUMBNAIL_SIZE * ThumbnailStore::THUMBNAIL_SIZE * 4;
+constexpr size_t SLOT_SIZE = (32 + THUMBNAIL_BYTES + 4095) / 4096 * 4096;
+
+struct PackHeader
+{
+    uint64_t magic;
+    uint64_t slotCount;
+    uint64_t slotSize;
+    uint64_t thumbnailSize;
+};
+
+namespace
+{
+    uint64_t thumbnailKey(const std::string& path)
+    {
+        // A single stat, the preview strip asks for the same files several times a second while they load
+        const auto file = statFile(path);
+        if (!file)
+        {
+            return 0;
+        }
+        const uint64_t fileSize = file->size;
+        const auto mtime = static_cast<uint64_t>(file->mtime);
+
+        // FNV-1a, so keys stay stable across runs and builds
+        uint64_t hash = 0xcbf29ce484222325;
+        const auto mix = [&hash](const void* data, const size_t size) {
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= static_cast<const uint8_t*>(data)[i];
+                hash *= 0x100000001b3;
+            }
+        };
+        mix(path.data(), path.size());
+        mix(&fileSize, sizeof(fileSize));
+        mix(&mtime, sizeof(mtime));
+
+        return hash == 0 ? 1 : hash;
+    }
+
+    // Writers hold the pack shared while filling a slot, opening it takes it exclusively to repair or reset it.
+    // Locks are released when their process dies, so holding it exclusively proves no slot is mid-write anywhere.
+    class PackLock
+    {
+    public:
+        PackLock(const int fd, const bool exclusive)
+        {
+#ifdef __linux__
+            if (fd >= 0 && flock(fd, exclusive ? LOCK_EX : LOCK_SH) == 0)
+            {
+                _fd = fd;
+            }
+#endif
+        }
+
+        PackLock(const PackLock&) = delete;
+
+        ~PackLock()
+        {
+#ifdef __linux__
+            if (_fd >= 0)
+            {
+                flock(_fd, LOCK_UN);
+            }
+#endif
+        }
+
+        bool isLocked() const { return _fd >= 0; }
+
+    private:
+        int _fd = -1;
+    };
+}
+
+static_assert(sizeof(PackHeader) <= PACK_HEADER_SIZE);
+
+ThumbnailStore::ThumbnailStore()
+    : _writeQueue(1)
+{
+    openPackFile();
+    if (!_data)
+    {
+        qDebug() << "Thumbnail pack file unavailable, keeping thumbnails in memory";
+        _slotCount = FALLBACK_SLOT_COUNT;
+        _fallbackData = std::make_unique<uchar[]>(PACK_HEADER_SIZE + (_slotCount * SLOT_SIZE));
+        _data = _fallbackData.get();
+    }
+}
+
+std::optional<QImage> ThumbnailStore::find(const std::string& path) const
+{
+    const uint64_t key = thumbnailKey(path);
+    if (key == 0)
+    {
+        return std::nullopt;
+    }
+
+    SlotHeader& header = slotHeader(key);
+    std::atomic_ref sequence(header.sequence);
+
+    // Seqlock read: a writer (possibly another process) may be overwriting the slot concurrently
+    const uint64_t before = sequence.load(std::memory_order_acquire);
+    if ((before & 1) != 0 || std::atomic_ref(header.key).load(std::memory_order_relaxed) != key)
+    {
+        return std::nullopt;
+    }
+
+    // Zero-sized entries record files that failed to decode
+    const int width = static_cast<int>(std::min<uint32_t>(header.width, THUMBNAIL_SIZE));
+    const int height = static_cast<int>(std::min<uint32_t>(header.height, THUMBNAIL_SIZE));
+    if (width == 0 || height == 0)
+    {
+        return std::nullopt;
+    }
+
+    QImage result(width, height, QImage::Format_ARGB32_Premultiplied);
+    const auto* pixels = reinterpret_cast<const uchar*>(&header) + sizeof(SlotHeader);
+    for (int y = 0; y < height; ++y)
+    {
+        std::memcpy(result.scanLine(y), pixels + (static_cast<size_t>(y) * width * 4), static_cast<size_t>(width) * 4);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) != before)
+    {
+        return std::nullopt;
+    }
+    return result;
+}
+
+bool ThumbnailStore::isUndecodable(const std::string& path) const
+{
+    const uint64_t key = thumbnailKey(path);
+    if (key == 0)
+    {
+        return false;
+    }
+
+    SlotHeader& header = slotHeader(key);
+    std::atomic_ref sequence(header.sequence);
+    const uint64_t before = sequence.load(std::memory_order_acquire);
+    if ((before & 1) != 0 || std::atomic_ref(header.key).load(std::memory_order_relaxed) != key)
+    {
+        return false;
+    }
+
+    const bool empty = header.width == 0 || header.height == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return empty && sequence.load(std::memory_order_relaxed) == before;
+}
+
+void ThumbnailStore::generate(const std::string& path)
+{
+    {
+        std::lock_guard lock(_mutex);
+        if (!_pending.insert(path).second)
+        {
+            return;
+        }
+    }
+
+    const auto finish = [this, path] {
+        std::lock_guard lock(_mutex);
+        _pending.erase(path);
+    };
+
+    _writeQueue.push(
+        path,
+        DecodePriority::Far,
+        [this, path, finish] {
+            const uint64_t key = thumbnailKey(path);
+            const QImage image = readThumbnailSource(path);
+            if (key != 0 && !image.isNull())
+            {
+                QImage thumbnail = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+                if (thumbnail.width() > THUMBNAIL_SIZE || thumbnail.height() > THUMBNAIL_SIZE)
+                {
+                    thumbnail = resample(
+                        thumbnail,
+                        thumbnail.size().scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio));
+                }
+                store(key, thumbnail);
+            }
+            else if (key != 0)
+            {
+                // Remembered so that the preview strip stops asking, until the file changes
+                store(key, QImage());
+            }
+            finish();
+        },
+        finish);
+}
+
+QImage ThumbnailStore::readThumbnailSource(const std::string& path)
+{
+    // Camera JPEGs usually carry a preview that is good enough and costs a few kilobytes of I/O
+    if (auto preview = readEmbeddedPreview(path, THUMBNAIL_SIZE))
+    {
+        return *preview;
+    }
+
+    QImageReader reader(QString::fromStdString(path));
+    const QSize originalSize = reader.size();
+    if (originalSize.isValid())
+    {
+        reader.setScaledSize(originalSize.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio));
+    }
+    return reader.read();
+}
+
+void ThumbnailStore::cancelPendingExcept(const std::vector<std::string>& paths)
+{
+    _writeQueue.cancelAllExcept({ paths.begin(), paths.end() });
+}
+
+void ThumbnailStore::openPackFile()
+{
+    const auto path = getCacheFilePath("thumbnails.pack");
+    std::error_code ec;
+    std::filesystem::create_directories(ien::get_file_directory(path), ec);
+
+    _file.setFileName(QString::fromStdString(path));
+    if (!_file.open(QIODevice::ReadWrite))
+    {
+        return;
+    }
+
+    // Other instances may have the pack mapped, so it only ever grows; shrinking it would fault their next access.
+    // Growing leaves the new range sparse until slots get written.
+    const PackLock lock(_file.handle(), true);
+    const qint64 totalSize = static_cast<qint64>(PACK_HEADER_SIZE + (PACK_SLOT_COUNT * SLOT_SIZE));
+    if (_file.size() < totalSize && !_file.resize(totalSize))
+    {
+        _file.close();
+        return;
+    }
+
+    _data = _file.map(0, totalSize);
+    if (!_data)
+    {
+        _file.close();
+        return;
+    }
+    _slotCount = PACK_SLOT_COUNT;
+
+    auto* header = reinterpret_cast<PackHeader*>(_data);
+    if (header->magic != PACK_MAGIC || header->slotCount != PACK_SLOT_COUNT || header->slotSize != SLOT_SIZE ||
+        header->thumbnailSize != THUMBNAIL_SIZE)
+    {
+        // Unknown or outdated layout, start over. Only slot headers need clearing, and only those that hold
+        // something, so the pixels of a fresh pack stay sparse instead of being written out as zeros.
+        for (size_t slot = 0; slot < _slotCount; ++slot)
+        {
+            auto* slotHeader = _data + PACK_HEADER_SIZE + (slot * SLOT_SIZE);
+            if (std::any_of(slotHeader, slotHeader + sizeof(SlotHeader), [](const uchar byte) { return byte != 0; }))
+            {
+                std::memset(slotHeader, 0, sizeof(SlotHeader));
+            }
+        }
+        std::memset(_data, 0, PACK_HEADER_SIZE);
+        *header = { .magic = PACK_MAGIC,
+                    .slotCount = PACK_SLOT_COUNT,
+                    .slotSize = SLOT_SIZE,
+                    .thumbnailSize = THUMBNAIL_SIZE };
+    }
+    else if (lock.isLocked())
+    {
+        resetInterruptedWrites();
+    }
+}
+
+void ThumbnailStore::resetInterruptedWrites() const
+{
+    // Only called with the pack locked exclusively, so an odd sequence was left behind by a writer that died
+    for (size_t slot = 0; slot < _slotCount; ++slot)
+    {
+        auto& header = *reinterpret_cast<SlotHeader*>(_data + PACK_HEADER_SIZE + (slot * SLOT_SIZE));
+        std::atomic_ref sequence(header.sequence);
+        const uint64_t current = sequence.load(std::memory_order_acquire);
+        if ((current & 1) != 0)
+        {
+            std::atomic_ref(header.key).store(0, std::memory_order_relaxed);
+            sequence.store(current + 1, std::memory_order_release);
+        }
+    }
+}
+
+ThumbnailStore::SlotHeader& ThumbnailStore::slotHeader(const uint64_t key) const
+{
+    const size_t slot = key % _slotCount;
+    return *reinterpret_cast<SlotHeader*>(_data + PACK_HEADER_SIZE + (slot * SLOT_SIZE));
+}
+
+void ThumbnailStore::store(const uint64_t key, const QImage& thumbnail) const
+{
+    SlotHeader& header = slotHeader(key);
+    std::atomic_ref sequence(header.sequence);
+
+    const PackLock lock(_file.handle(), false);
+    uint64_t current = sequence.load(std::memory_order_acquire);
+    if ((current & 1) != 0 || !sequence.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel))
+    {
+        // Someone else is writing this slot right now, the thumbnail will be regenerated on a later miss
+        return;
+    }
+
+    header.width = thumbnail.width();
+    header.height = thumbnail.height();
+    auto* pixels = reinterpret_cast<uchar*>(&header) + sizeof(SlotHeader);
+    for (int y = 0; y < thumbnail.height(); ++y)
+    {
+        std::memcpy(
+            pixels + (static_cast<size_t>(y) * thumbnail.width() * 4),
+            thumbnail.constScanLine(y),
+            static_cast<size_t>(thumbnail.width()) * 4);
+    }
+    std::atomic_ref(header.key).store(key, std::memory_order_relaxed);
+    sequence.store(current + 2, std::memory_order_release);
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QFile>
+#include <QImage>
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "DecodeQueue.hpp"
+
+// Fixed-size thumbnails kept in a memory-mapped pack file, keyed by (path, size, mtime)
+class ThumbnailStore
+{
+public:
+    static constexpr int THUMBNAIL_SIZE = 116;
+
+    ThumbnailStore();
+    ThumbnailStore(const ThumbnailStore&) = delete;
+
+    std::optional<QImage> find(const std::string& path) const;
+    // A previous generate() found the file in its current state undecodable
+    bool isUndecodable(const std::string& path) const;
+    void generate(const std::string& path);
+    void cancelPendingExcept(const std::vector<std::string>& paths);
+
+private:
+    struct SlotHeader
+    {
+        uint64_t sequence;
+        uint64_t key;
+        uint32_t width;
+        uint32_t height;
+        uint64_t reserved;
+    };
+
+    QFile _file;
+    uchar* _data = nullptr;
+    std::unique_ptr<uchar[]> _fallbackData;
+    size_t _slotCount = 0;
+
+    std::unordered_set<std::string> _pending;
+    std::mutex _mutex;
+    // Declared last so that pending writes are abandoned before the mapping goes away
+    DecodeQueue _writeQueue;
+
+    static QImage readThumbnailSource(const std::string& path);
+    void openPackFile();
+    void resetInterruptedWrites() const;
+    SlotHeader& slotHeader(uint64_t key) const;
+    void store(uint64_t key, const QImage& thumbnail) const;
+};
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "TiledImage.hpp"
+
+#include <QPainter>
+
+#include <algorithm>
+#include <cmath>
+
+#include "Resampler.hpp"
+
+namespace
+{
+    // Past this level the overview is already sharper than what tiles would give
+    constexpr int MAX_LEVEL = 8;
+}
+
+bool isTiledSize(const QSize originalSize)
+{
+    return static_cast<qint64>(originalSize.width()) * originalSize.height() > TILED_PIXEL_THRESHOLD;
+}
+
+QSize levelSize(const QSize originalSize, const int level)
+{
+    const int divisor = 1 << level;
+    return { (originalSize.width() + divisor - 1) / divisor, (originalSize.height() + divisor - 1) / divisor };
+}
+
+QRect tileRect(const QSize originalSize, const TileKey& tile)
+{
+    return QRect(tile.column * TILE_SIZE, tile.row * TILE_SIZE, TILE_SIZE, TILE_SIZE) &
+           QRect(QPoint(0, 0), levelSize(originalSize, tile.level));
+}
+
+TileView tileViewFor(const QSize originalSize, const RenderParameters& parameters)
+{
+    const QRect sourceRect = renderSourceRect(originalSize, parameters);
+    const QSize targetSize =
+        sourceRect.size().scaled(parameters.viewportSize * parameters.devicePixelRatio, Qt::KeepAspectRatio);
+    if (sourceRect.isEmpty() || targetSize.isEmpty())
+    {
+        return {};
+    }
+
+    // The coarsest level that still has at least as many pixels as the output
+    const double scale = static_cast<double>(targetSize.width()) / sourceRect.width();
+    const int level = scale >= 1.0 ? 0 : std::min(MAX_LEVEL, static_cast<int>(std::floor(std::log2(1.0 / scale))));
+    const double levelScale = std::ldexp(1.0, -level);
+
+    const int left = static_cast<int>(std::floor(sourceRect.left() * levelScale));
+    const int top = static_cast<int>(std::floor(sourceRect.top() * levelScale));
+    const int right = static_cast<int>(std::ceil((sourceRect.left() + sourceRect.width()) * levelScale));
+    const int bottom = static_cast<int>(std::ceil((sourceRect.top() + sourceRect.height()) * levelScale));
+    const QRect levelRect =
+        QRect(left, top, right - left, bottom - top) & QRect(QPoint(0, 0), levelSize(originalSize, level));
+
+    TileView view{ .level = level, .levelRect = levelRect, .targetSize = targetSize };
+    if (levelRect.isEmpty())
+    {
+        return view;
+    }
+
+    for (int row = levelRect.top() / TILE_SIZE; row <= levelRect.bottom() / TILE_SIZE; ++row)
+    {
+        for (int column = levelRect.left() / TILE_SIZE; column <= levelRect.right() / TILE_SIZE; ++column)
+        {
+            view.tiles.push_back({ .level = level, .column = column, .row = row });
+        }
+    }
+    return view;
+}
+
+QImage renderTiles(const TileView& view, const std::vector<std::pair<TileKey, std::shared_ptr<QImage>>>& tiles)
+{
+    QImage composed(view.levelRect.size(), QImage::Format_ARGB32_Premultiplied);
+    composed.fill(Qt::transparent);
+    {
+        QPainter painter(&composed);
+        for (const auto& [tile, image] : tiles)
+        {
+            if (image && !image->isNull())
+            {
+                const QPoint position(tile.column * TILE_SIZE, tile.row * TILE_SIZE);
+                painter.drawImage(position - view.levelRect.topLeft(), *image);
+            }
+        }
+    }
+    return resample(composed, view.targetSize);
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "RenderCache.hpp"
+
+// Images with more pixels than this are shown from a reduced overview plus tiles decoded on demand
+constexpr qint64 TILED_PIXEL_THRESHOLD = 64LL * 1024 * 1024;
+// Longest side of the overview decoded for tiled images
+constexpr int TILED_OVERVIEW_SIZE = 4096;
+constexpr int TILE_SIZE = 1024;
+
+// A tile of the image scaled down by 2^level
+struct TileKey
+{
+    int level = 0;
+    int column = 0;
+    int row = 0;
+
+    bool operator==(const TileKey&) const = default;
+};
+
+// Tiles needed to render the visible part of a tiled image
+struct TileView
+{
+    int level = 0;
+    // Visible area in the coordinates of the level
+    QRect levelRect;
+    QSize targetSize;
+    std::vector<TileKey> tiles;
+};
+
+bool isTiledSize(QSize originalSize);
+QSize levelSize(QSize originalSize, int level);
+// Area covered by a tile in the coordinates of its level, smaller than TILE_SIZE at the right and bottom edges
+QRect tileRect(QSize originalSize, const TileKey& tile);
+TileView tileViewFor(QSize originalSize, const RenderParameters& parameters);
+// Stitches the decoded tiles of a view together and scales them to its target size
+QImage renderTiles(const TileView& view, const std::vector<std::pair<TileKey, std::shared_ptr<QImage>>>& tiles);
\ No newline at end of file
@@ -9,132 +9,243 @@
 #include <QMediaMetaData>
 #include <QProcess>
 
+#include <algorithm>
+#include <array>
 #include <cstdio>
 #include <filesystem>
+#include <list>
+#include <mutex>
 #include <ranges>
-#include <span>
 #include <sstream>
-#include <unordered_set>
+#include <string_view>
 
-const std::unordered_set<std::string> ANIMATION_EXTENSIONS = { ".gif", ".png", ".webp" };
-const std::unordered_set<std::string> IMAGE_EXTENSIONS = { ".png", ".jpg", ".jpeg", ".webp" };
-const std::unordered_set<std::string> VIDEO_EXTENSIONS = { ".mkv", ".mp4", ".webm", ".mov" };
+#include "AnimationPlayer.hpp"
 
-constexpr auto JXL_EXTENSION = ".jxl";
-
-constexpr auto APNG_IDAT_STR = "IDAT";
-constexpr auto APNG_ACTL_STR = "acTL";
-constexpr auto WEBP_ANIM_STR = "ANIM";
-constexpr auto WEBP_ANMF_STR = "ANMF";
+enum class ExtensionKind
+{
+    None,
+    // Still or animated, decided by the file header
+    Picture,
+    Jxl,
+    Video
+};
 
-constexpr auto APNG_CHECK_BUFFER_SIZE = 256;
+constexpr std::array<std::pair<std::string_view, ExtensionKind>, 10> MEDIA_EXTENSIONS = { {
+    { ".gif", ExtensionKind::Picture },
+    { ".png", ExtensionKind::Picture },
+    { ".jpg", ExtensionKind::Picture },
+    { ".jpeg", ExtensionKind::Picture },
+    { ".webp", ExtensionKind::Picture },
+    { ".jxl", ExtensionKind::Jxl },
+    { ".mkv", ExtensionKind::Video },
+    { ".mp4", ExtensionKind::Video },
+    { ".webm", ExtensionKind::Video },
+    { ".mov", ExtensionKind::Video },
+} };
+
+constexpr std::string_view PNG_SIGNATURE = "\x89PNG\r\n\x1a\n";
+constexpr std::string_view GIF87_SIGNATURE = "GIF87a";
+constexpr std::string_view GIF89_SIGNATURE = "GIF89a";
+constexpr std::string_view JPEG_SIGNATURE = "\xff\xd8\xff";
+constexpr std::string_view WEBP_VP8X_CHUNK = "VP8X";
+constexpr uint8_t WEBP_ANIMATION_FLAG = 0x02;
+constexpr size_t WEBP_FLAGS_OFFSET = 20;
+
+// acTL has to precede the first IDAT and encoders write it right after IHDR, so this covers any real file
+constexpr size_t SNIFF_BUFFER_SIZE = 16 * 1024;
 
 static const bool JXL_SUPPORT = QImageReader::supportedImageFormats().contains("jxl");
 
-bool isPngAnimated(const std::span<const std::byte> data)
+namespace
 {
-    if (data.empty())
+    constexpr bool extensionEquals(const std::string_view extension, const std::string_view lowercase)
     {
-        return false;
+        return std::ranges::equal(extension, lowercase, [](const char a, const char b) {
+            return (a >= 'A' && a <= 'Z' ? static_cast<char>(a - 'A' + 'a') : a) == b;
+        });
     }
 
-    const std::string_view sv(reinterpret_cast<const char*>(data.data()), data.size());
-    const size_t idat_pos = sv.find(APNG_IDAT_STR);
-    if (idat_pos == std::string_view::npos)
+    ExtensionKind extensionKind(const std::string_view path)
     {
+        const size_t dot = path.find_last_of('.');
+        if (dot == std::string_view::npos || path.find_first_of("/\\", dot) != std::string_view::npos)
+        {
+            return ExtensionKind::None;
+        }
+
+        const auto extension = path.substr(dot);
+        for (const auto& [candidate, kind] : MEDIA_EXTENSIONS)
+        {
+            if (extensionEquals(extension, candidate))
+            {
+                return kind == ExtensionKind::Jxl && !JXL_SUPPORT ? ExtensionKind::None : kind;
+            }
+        }
+        return ExtensionKind::None;
+    }
+
+    uint32_t readBigEndian32(const std::string_view data, const size_t offset)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(data.data() + offset);
+        return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) |
+               (static_cast<uint32_t>(bytes[2]) << 8) | static_cast<uint32_t>(bytes[3]);
+    }
+
+    bool isPngAnimated(const std::string_view header)
+    {
+        // Walks chunk headers instead of searching, so chunk payloads can't produce false matches
+        size_t offset = PNG_SIGNATURE.size();
+        while (offset + 8 <= header.size())
+        {
+            const uint32_t length = readBigEndian32(header, offset);
+            const auto type = header.substr(offset + 4, 4);
+            if (type == "acTL")
+            {
+                return true;
+            }
+            if (type == "IDAT" || type == "IEND")
+            {
+                return false;
+            }
+            // Length, type and CRC surround the payload
+            offset += static_cast<size_t>(length) + 12;
+        }
         return false;
     }
 
-    return sv.substr(0, idat_pos).find(APNG_ACTL_STR) != std::string_view::npos;
-}
+    bool isWebpAnimated(const std::string_view header)
+    {
+        // Only the extended format can hold an animation, its flags follow the VP8X chunk header
+        return header.size() > WEBP_FLAGS_OFFSET && header.substr(12, 4) == WEBP_VP8X_CHUNK &&
+               (static_cast<uint8_t>(header[WEBP_FLAGS_OFFSET]) & WEBP_ANIMATION_FLAG) != 0;
+    }
 
-bool isWebpAnimated(const std::span<const std::byte> data)
-{
-    const std::string_view sv(reinterpret_cast<const char*>(data.data()), data.size());
-    return sv.find(WEBP_ANIM_STR) != std::string_view::npos && sv.find(WEBP_ANMF_STR) != std::string_view::npos;
+    MediaKind sniffPicture(const std::string& path)
+    {
+        std::array<char, SNIFF_BUFFER_SIZE> buffer{};
+        ien::unique_file_descriptor fd(path, ien::unique_file_descriptor_mode::READ);
+        const auto bytesRead = fd.read(buffer.data(), buffer.size());
+        if (bytesRead == 0)
+        {
+            return MediaKind::None;
+        }
+
+        const std::string_view header(buffer.data(), static_cast<size_t>(bytesRead));
+        if (header.starts_with(PNG_SIGNATURE))
+        {
+            return isPngAnimated(header) ? MediaKind::Animation : MediaKind::Image;
+        }
+        if (header.starts_with(GIF87_SIGNATURE) || header.starts_with(GIF89_SIGNATURE))
+        {
+            return MediaKind::Animation;
+        }
+        if (header.starts_with("RIFF") && header.size() >= 12 && header.substr(8, 4) == "WEBP")
+        {
+            return isWebpAnimated(header) ? MediaKind::Animation : MediaKind::Image;
+        }
+        if (header.starts_with(JPEG_SIGNATURE))
+        {
+            return MediaKind::Image;
+        }
+        // Unknown content behind an image extension is left for the image reader to accept or reject
+        return MediaKind::Image;
+    }
+
+    // Enough for several large directories, older entries are forgotten first
+    constexpr size_t MAX_CLASSIFIED_FILES = 65536;
+
+    struct ClassifiedFile
+    {
+        std::filesystem::file_time_type modified;
+        MediaKind kind;
+        std::list<std::string>::iterator lruIterator;
+    };
+
+    std::mutex classifiedFilesMutex;
+    std::unordered_map<std::string, ClassifiedFile> classifiedFiles;
+    // Most recently used first
+    std::list<std::string> classifiedFilesLru;
+
+    std::string getHomeFilePath(const std::string& relativePath)
+    {
+        auto path = ien::get_current_user_homedir();
+        if (!path.ends_with("/") && !path.ends_with("\\"))
+        {
+            path += std::filesystem::path::preferred_separator;
+        }
+        return path + relativePath;
+    }
 }
 
 bool hasMediaExtension(const std::string& path)
 {
-    const auto ext = ien::str_tolower(ien::get_file_extension(path));
-    return IMAGE_EXTENSIONS.contains(ext) || ANIMATION_EXTENSIONS.contains(ext) || VIDEO_EXTENSIONS.contains(ext) ||
-           (JXL_SUPPORT && ext == JXL_EXTENSION);
+    return extensionKind(path) != ExtensionKind::None;
 }
 
-bool isImage(const std::string& path)
+MediaKind classifyMedia(const std::string& path)
 {
-    const auto ext = ien::str_tolower(ien::get_file_extension(path));
-    if (isAnimation(path))
+    switch (extensionKind(path))
     {
-        return false;
+    case ExtensionKind::None:
+        return MediaKind::None;
+    case ExtensionKind::Jxl:
+        return MediaKind::Image;
+    case ExtensionKind::Video:
+        return MediaKind::Video;
+    case ExtensionKind::Picture:
+        break;
     }
-    return IMAGE_EXTENSIONS.contains(ext) || (JXL_SUPPORT && ext == JXL_EXTENSION);
-}
 
-bool isAnimation(const std::string& path, const bool shallow)
-{
-    const std::string extension = ien::str_tolower(ien::get_file_extension(path));
-    if (ANIMATION_EXTENSIONS.contains(extension))
+    std::error_code error;
+    const auto modified = std::filesystem::last_write_time(path, error);
+    if (error)
     {
-        if (shallow)
+        return MediaKind::None;
+    }
+
+    {
+        std::lock_guard lock(classifiedFilesMutex);
+        if (const auto it = classifiedFiles.find(path); it != classifiedFiles.end() && it->second.modified == modified)
         {
-            return false;
+            classifiedFilesLru.splice(classifiedFilesLru.begin(), classifiedFilesLru, it->second.lruIterator);
+            return it->second.kind;
         }
+    }
 
-        if (extension == ".png")
-        {
-            std::array<char, APNG_CHECK_BUFFER_SIZE> data{};
-            ien::unique_file_descriptor fd(path, ien::unique_file_descriptor_mode::READ);
+    const MediaKind kind = sniffPicture(path);
+    std::lock_guard lock(classifiedFilesMutex);
+    if (const auto it = classifiedFiles.find(path); it != classifiedFiles.end())
+    {
+        classifiedFilesLru.splice(classifiedFilesLru.begin(), classifiedFilesLru, it->second.lruIterator);
+        it->second.modified = modified;
+        it->second.kind = kind;
+        return kind;
+    }
 
-            bool first_chunk = true;
-            bool eof = false;
-            for (;;)
-            {
-                if (first_chunk)
-                {
-                    if (fd.read(data.data(), APNG_CHECK_BUFFER_SIZE) < APNG_CHECK_BUFFER_SIZE)
-                    {
-                        eof = true;
-                    }
-                    first_chunk = false;
-                }
-                else
-                {
-                    // Copy last three characters to the beginning of the buffer to check against new data
-                    data[0] = data[APNG_CHECK_BUFFER_SIZE - 3];
-                    data[1] = data[APNG_CHECK_BUFFER_SIZE - 2];
-                    data[2] = data[APNG_CHECK_BUFFER_SIZE - 1];
-                    if (fd.read(data.data(), APNG_CHECK_BUFFER_SIZE - 3) < APNG_CHECK_BUFFER_SIZE - 3)
-                    {
-                        eof = true;
-                    }
-                }
-                std::string_view sv(data.data(), data.size());
-                if (sv.contains(APNG_ACTL_STR))
-                {
-                    return true;
-                }
-                if (sv.contains(APNG_IDAT_STR) || eof)
-                {
-                    return false;
-                }
-            }
-        }
-        if (extension == ".webp")
-        {
-            return isWebpAnimated(*ien::read_file_binary(path));
-        }
-        if (extension == ".gif")
-        {
-            return true;
-        }
+    if (classifiedFiles.size() >= MAX_CLASSIFIED_FILES)
+    {
+        classifiedFiles.erase(classifiedFilesLru.back());
+        classifiedFilesLru.pop_back();
     }
-    return false;
+    classifiedFilesLru.push_front(path);
+    classifiedFiles.emplace(
+        path, ClassifiedFile{ .modified = modified, .kind = kind, .lruIterator = classifiedFilesLru.begin() });
+    return kind;
+}
+
+bool isImage(const std::string& path)
+{
+    return classifyMedia(path) == MediaKind::Image;
+}
+
+bool isAnimation(const std::string& path)
+{
+    return classifyMedia(path) == MediaKind::Animation;
 }
 
 bool isVideo(const std::string& path)
 {
-    return VIDEO_EXTENSIONS.contains(ien::str_tolower(ien::get_file_extension(path)));
+    return classifyMedia(path) == MediaKind::Video;
 }
 
 std::unordered_map<int, std::string> getLinksFromFile(const std::string& path)
@@ -173,6 +284,65 @@ std::unordered_map<int, std::string> getLinksFromFile(const std::string& path)
     return result;
 }
 
+Settings getSettingsFromFile(const std::string& path)
+{
+    Settings result;
+
+    const auto settings_text = ien::read_file_text(path);
+    if (!settings_text)
+    {
+        return result;
+    }
+
+    for (auto& ln : ien::str_split(*settings_text, '\n'))
+    {
+        ln = ien::str_trim(ln);
+        if (ln.empty() || ln.starts_with('#'))
+        {
+            continue;
+        }
+
+        auto segments = ien::str_split(ln, ':');
+        if (segments.size() != 2)
+        {
+            continue;
+        }
+
+        const std::string key(ien::str_trim(segments[0]));
+        const std::string value(ien::str_trim(segments[1]));
+        try
+        {
+            if (key == "cache_budget_mb")
+            {
+                result.cacheBudgetMB = std::stoull(value);
+            }
+            else if (key == "encoded_cache_budget_mb")
+            {
+                result.encodedCacheBudgetMB = std::stoull(value);
+            }
+            else if (key == "adaptive_cache_budget")
+            {
+                result.adaptiveCacheBudget = value == "true" || value == "1";
+            }
+        }
+        catch ([[maybe_unused]] std::exception&)
+        {
+            printf("Invalid value for setting '%s': %s\n", key.c_str(), value.c_str());
+        }
+    }
+    return result;
+}
+
+std::string getConfigFilePath(const std::string& name)
+{
+    return getHomeFilePath(".config/igal_qt/" + name);
+}
+
+std::string getCacheFilePath(const std::string& name)
+{
+    return getHomeFilePath(".cache/igal_qt/" + name);
+}
+
 std::vector<std::string> getImageUpscaleModels()
 {
     static const std::vector<std::string>
@@ -239,22 +409,26 @@ CopyFileToLinkDirResult copyFileToLinkDir(const std::string& file, const std::st
 
 std::string getFileInfoString(
     const std::string& file,
-    const std::variant<const QImage*, const QMovie*, const QMediaPlayer*> currentSource)
+    const std::variant<QSize, const AnimationPlayer*, const QMediaPlayer*> currentSource)
 {
     std::stringstream sstr;
     sstr << "&nbsp;&nbsp;<b>Filename</b>: <i>" << ien::get_file_name(file) << "</i><br>";
     sstr << "&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;&nbsp;<b>Size</b>: <i>"
          << static_cast<float>(std::filesystem::file_size(file)) / 1000000 << "MB</i><br>";
-    if (std::holds_alternative<const QMovie*>(currentSource))
+    if (std::holds_alternative<const AnimationPlayer*>(currentSource))
     {
-        const auto movie = std::get<const QMovie*>(currentSource);
-        sstr << "<b>Dimensions</b>: <i>" << movie->currentImage().size().width() << "x"
-             << movie->currentImage().size().width() << "</i><br>";
+        const auto animation = std::get<const AnimationPlayer*>(currentSource);
+        sstr << "<b>Dimensions</b>: <i>" << animation->currentImage().size().width() << "x"
+             << animation->currentImage().size().width() << "</i><br>";
     }
-    else if (std::holds_alternative<const QImage*>(currentSource))
+    else if (std::holds_alternative<QSize>(currentSource))
     {
-        const auto image = std::get<const QImage*>(currentSource);
-        sstr << "<b>Dimensions</b>: <i>" << image->width() << "x" << image->height() << "</i><br>";
+        // Invalid while the image is still decoding
+        const auto dimensions = std::get<QSize>(currentSource);
+        if (dimensions.isValid())
+        {
+            sstr << "<b>Dimensions</b>: <i>" << dimensions.width() << "x" << dimensions.height() << "</i><br>";
+        }
     }
     else if (std::holds_alternative<const QMediaPlayer*>(currentSource))
     {
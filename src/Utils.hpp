@@ -3,7 +3,6 @@
 #include <QFont>
 #include <QImage>
 #include <QMediaPlayer>
-#include <QMovie>
 #include <QWidget>
 
 #include <functional>
@@ -11,11 +10,34 @@
 #include <unordered_map>
 #include <variant>
 
+class AnimationPlayer;
+
+enum class MediaKind
+{
+    None,
+    Image,
+    Animation,
+    Video
+};
+
 bool hasMediaExtension(const std::string& path);
+// Decided by the extension and a single header read, remembered until the file is modified
+MediaKind classifyMedia(const std::string& path);
 bool isImage(const std::string& path);
-bool isAnimation(const std::string& path, bool shallow = false);
+bool isAnimation(const std::string& path);
 bool isVideo(const std::string& path);
 std::unordered_map<int, std::string> getLinksFromFile(const std::string& path);
+
+struct Settings
+{
+    size_t cacheBudgetMB = 1024;
+    size_t encodedCacheBudgetMB = 512;
+    bool adaptiveCacheBudget = true;
+};
+
+Settings getSettingsFromFile(const std::string& path);
+std::string getConfigFilePath(const std::string& name);
+std::string getCacheFilePath(const std::string& name);
 std::vector<std::string> getImageUpscaleModels();
 std::vector<std::string> getVideoUpscaleModels();
 std::pair<std::string, unsigned int> videoUpscaleModelToStringAndFactor(const std::string& str);
@@ -31,7 +53,7 @@ enum class CopyFileToLinkDirResult
 
 [[nodiscard]] CopyFileToLinkDirResult copyFileToLinkDir(const std::string& file, const std::string& linkDir);
 
-std::string getFileInfoString(const std::string& file, std::variant<const QImage*, const QMovie*, const QMediaPlayer*> currentSource);
+std::string getFileInfoString(const std::string& file, std::variant<QSize, const AnimationPlayer*, const QMediaPlayer*> currentSource);
 
 QFont getTextFont(int size = 8);
 
@@ -0,0 +1,149 @@
+#include <QImage>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CachedMediaProxy.hpp"
+
+// Hammers the sharded cache index from the threads that use it in the viewer (main view, prefetcher, preview
+// strip) while a small budget keeps the clocks evicting. Meant to be run under ThreadSanitizer.
+namespace
+{
+    constexpr int IMAGE_COUNT = 48;
+    constexpr int THREAD_COUNT = 6;
+    constexpr auto DURATION = std::chrono::seconds(5);
+    constexpr size_t BUDGET_MB = 4;
+
+    std::vector<std::string> writeImages(const std::filesystem::path& directory)
+    {
+        std::filesystem::create_directories(directory);
+        std::vector<std::string> result;
+        for (int i = 0; i < IMAGE_COUNT; ++i)
+        {
+            QImage image(256 + (i * 7), 192 + (i * 5), QImage::Format_RGB32);
+            image.fill(QColor::fromHsv((i * 37) % 360, 200, 200));
+            const auto path = (directory / std::format("{:03}.png", i)).string();
+            if (!image.save(QString::fromStdString(path)))
+            {
+                return {};
+            }
+            result.push_back(path);
+        }
+        return result;
+    }
+
+    bool checkImage(const std::shared_future<CachedImage>& future)
+    {
+        // Cancelled requests resolve to a null image, anything decoded must have its real dimensions
+        const auto& cachedImage = future.get();
+        return cachedImage.image()->isNull() || cachedImage.originalSize().width() >= 256;
+    }
+}
+
+int main()
+{
+    const auto directory = std::filesystem::temp_directory_path() / "igal_qt_cache_stress";
+    const auto paths = writeImages(directory);
+    if (paths.empty())
+    {
+        std::fprintf(stderr, "Failed to write test images to %s\n", directory.string().c_str());
+        return 1;
+    }
+
+    CachedMediaProxy proxy(BUDGET_MB, BUDGET_MB);
+    std::atomic_bool failed = false;
+    std::atomic_size_t operations = 0;
+    const auto deadline = std::chrono::steady_clock::now() + DURATION;
+
+    std::vector<std::jthread> threads;
+    for (int t = 0; t < THREAD_COUNT; ++t)
+    {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            std::uniform_int_distribution<int> pick(0, IMAGE_COUNT - 1);
+            while (std::chrono::steady_clock::now() < deadline && !failed)
+            {
+                const auto& path = paths[pick(rng)];
+                switch (rng() % 10)
+                {
+                case 0:
+                case 1:
+                case 2:
+                    if (!checkImage(proxy.getImage(path)))
+                    {
+                        failed = true;
+                    }
+                    break;
+                case 3:
+                    proxy.preCacheImage(path, static_cast<DecodePriority>(rng() % 4));
+                    break;
+                case 4:
+                {
+                    std::vector<std::string> keep;
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        keep.push_back(paths[pick(rng)]);
+                    }
+                    proxy.cancelPrecacheExcept(keep);
+                    break;
+                }
+                case 5:
+                    proxy.setDisplayedImage(path);
+                    break;
+                case 6:
+                    proxy.invalidate(path);
+                    break;
+                case 7:
+                    if (!checkImage(proxy.getFullImage(path)))
+                    {
+                        failed = true;
+                    }
+                    break;
+                case 8:
+                    proxy.setMaxCacheSize((BUDGET_MB / 2 + rng() % BUDGET_MB) * 1024 * 1024);
+                    break;
+                case 9:
+                    proxy.usage();
+                    if (rng() % 50 == 0)
+                    {
+                        proxy.trim();
+                    }
+                    break;
+                }
+                ++operations;
+            }
+        });
+    }
+    threads.clear();
+
+    // Every path requested once more waits out the decodes still in flight before checking the accounting
+    for (const auto& path : paths)
+    {
+        if (!checkImage(proxy.getImage(path)))
+        {
+            failed = true;
+        }
+    }
+    proxy.setMaxCacheSize(BUDGET_MB * 1024 * 1024);
+    proxy.trim();
+
+    // An eviction or invalidation counted twice shows up as a wrapped around total
+    const auto usage = proxy.usage();
+    if (usage.currentSize > usage.maxSize)
+    {
+        std::fprintf(stderr, "Cache size %zu exceeds budget %zu after trim\n", usage.currentSize, usage.maxSize);
+        failed = true;
+    }
+
+    std::printf(
+        "%zu operations, %zu entries left, %zu bytes cached\n", operations.load(), usage.entryCount, usage.currentSize);
+    std::filesystem::remove_all(directory);
+    return failed ? 1 : 0;
+}